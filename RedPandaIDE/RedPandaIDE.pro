@@ -1,4 +1,4 @@
-QT       += core gui printsupport network svg
+QT       += core gui printsupport network svg concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -37,6 +37,7 @@ SOURCES += \
     parser/cpptokenizer.cpp \
     parser/parserutils.cpp \
     parser/statementmodel.cpp \
+    parser/systemheadercache.cpp \
     problems/ojproblemset.cpp \
     problems/problemcasevalidator.cpp \
     project.cpp \
@@ -158,6 +159,7 @@ HEADERS += \
     parser/cpptokenizer.h \
     parser/parserutils.h \
     parser/statementmodel.h \
+    parser/systemheadercache.h \
     platform.h \
     problems/ojproblemset.h \
     problems/problemcasevalidator.h \
@@ -6,6 +6,7 @@
 #include "../editor.h"
 
 #include <QDir>
+#include <QThread>
 
 ProjectCompiler::ProjectCompiler(std::shared_ptr<Project> project, bool silent, bool onlyCheckSyntax):
     Compiler("",silent,onlyCheckSyntax)
@@ -242,6 +243,13 @@ void ProjectCompiler::writeMakeTarget(QFile &file)
     writeln(file);
     writeln(file, "all: all-before $(BIN) all-after");
     writeln(file);
+    // keep the build steps in order when make runs jobs in parallel
+    writeln(file, "$(OBJ) $(PCH): | all-before");
+    writeln(file, "all-after: $(BIN)");
+    writeln(file, "ifneq ($(filter clean,$(MAKECMDGOALS)),)");
+    writeln(file, "all-before: clean");
+    writeln(file, "endif");
+    writeln(file);
     if (mProject->options().usePrecompiledHeader) {
         writeln(file, "$(PCH) : $(PCH_H)");
         writeln(file, "  $(CPP) -x c++-header \"$(PCH_H)\" -o \"$(PCH)\" $(CXXFLAGS)");
@@ -473,6 +481,12 @@ bool ProjectCompiler::prepareForCompile()
                                                       mProject->directory(),
                                                       mProject->makeFileName()));
     }
+    // compile the units in parallel, our makefiles are safe for it. Makefiles
+    // included into ours may have recipes (like all-before) that are not.
+    if (!mProject->options().useCustomMakefile
+            && mProject->options().makeIncludes.isEmpty()
+            && QThread::idealThreadCount()>1)
+        mArguments += QString(" -j%1").arg(QThread::idealThreadCount());
     mDirectory = mProject->directory();
 
     log(tr("Processing makefile:"));
@@ -63,6 +63,9 @@ bool Debugger::start()
     connect(mReader, &QThread::finished,this,&Debugger::clearUpReader);
     connect(mReader, &DebugReader::parseFinished,this,&Debugger::syncFinishedParsing,Qt::BlockingQueuedConnection);
     connect(mReader, &DebugReader::changeDebugConsoleLastLine,this,&Debugger::onChangeDebugConsoleLastline);
+    connect(mReader, &DebugReader::watchValueReady,this,&Debugger::onWatchValueReady);
+    connect(mReader, &DebugReader::watchVarInvalid,this,&Debugger::onWatchVarInvalid);
+    connect(mReader, &DebugReader::watchVarsDisplayed,this,&Debugger::onWatchVarsDisplayed);
     connect(this, &Debugger::localsReady,pMainWindow,&MainWindow::onLocalsReady);
     connect(mReader, &DebugReader::cmdStarted,pMainWindow, &MainWindow::disableDebugActions);
     connect(mReader, &DebugReader::cmdFinished,pMainWindow, &MainWindow::enableDebugActions);
@@ -324,6 +327,11 @@ void Debugger::invalidateWatchVar(const QString &name)
 void Debugger::invalidateWatchVar(PWatchVar var)
 {
     var->gdbIndex = -1;
+    resetWatchVarValue(var);
+}
+
+void Debugger::resetWatchVarValue(PWatchVar var)
+{
     QString value;
     if (mExecuting) {
         value = tr("Not found in current context");
@@ -331,6 +339,9 @@ void Debugger::invalidateWatchVar(PWatchVar var)
         value = tr("Execute to evaluate");
     }
     var->value = value;
+    var->rawValue = "";
+    var->childTokens.clear();
+    var->pendingChildren.clear();
     if (var->children.isEmpty()) {
         mWatchModel->notifyUpdated(var);
     } else {
@@ -350,6 +361,35 @@ PWatchVar Debugger::findWatchVar(const QString &name)
 //    mWatchModel->notifyUpdated(var);
 //}
 
+void Debugger::onWatchValueReady(const QString &name, int gdbIndex, const QString &value)
+{
+    PWatchVar watchVar = mWatchModel->findWatchVar(name);
+    if (!watchVar)
+        return;
+    // Refresh GDB index so we can undisplay this by index
+    watchVar->gdbIndex = gdbIndex;
+    // gdb displays all watches at each stop, don't rebuild unchanged ones
+    if (value == watchVar->rawValue)
+        return;
+    notifyBeforeProcessWatchVar();
+    processWatchOutput(watchVar,value);
+    notifyAfterProcessWatchVar();
+}
+
+void Debugger::onWatchVarInvalid(const QString &name)
+{
+    invalidateWatchVar(name);
+}
+
+void Debugger::onWatchVarsDisplayed(const QStringList &names)
+{
+    for (const PWatchVar& var:mWatchModel->watchVars()) {
+        if (var->gdbIndex != -1 && !names.contains(var->name)
+                && !var->rawValue.isEmpty())
+            resetWatchVarValue(var);
+    }
+}
+
 void Debugger::notifyBeforeProcessWatchVar()
 {
     mWatchModel->beginUpdate();
@@ -744,14 +784,10 @@ AnnotationType DebugReader::getAnnotation(const QString &s)
     }
 }
 
-AnnotationType DebugReader::getLastAnnotation(const QByteArray &text)
+AnnotationType DebugReader::getLastAnnotation(const QByteArray &text, int annotationPos)
 {
-    int curpos = text.length()-1;
-    // Walk back until end of #26's
-    while ((curpos >= 0) && (text[curpos] != 26))
-        curpos--;
-
-    curpos++;
+    // annotationPos is the position of the last #26 in text
+    int curpos = annotationPos+1;
 
     // Tiny rewrite of GetNextWord for special purposes
     QString s = "";
@@ -864,12 +900,11 @@ void DebugReader::handleDisplay()
         // Advance up to the value
         if (!findAnnotation(AnnotationType::TDisplayExpression))
             return;;
-        // Refresh GDB index so we can undisplay this by index
-        watchVar->gdbIndex = s.toInt();
-        mDebugger->notifyBeforeProcessWatchVar();
-        processWatchOutput(watchVar);
-        mDebugger->notifyAfterProcessWatchVar();
-        //mDebugger->notifyWatchVarUpdated(watchVar);
+        QString value = processEvalOutput();
+        mDisplayedWatchVars.append(watchName);
+        // The watch var is rebuilt in the GUI thread, where the watch model
+        // reads its children
+        emit watchValueReady(watchName,s.toInt(),value);
     }
 }
 
@@ -885,7 +920,7 @@ void DebugReader::handleError()
         QString watchName = s.mid(head+1, tail-head-1);
 
         // Update current..
-        mDebugger->invalidateWatchVar(watchName);
+        emit watchVarInvalid(watchName);
     }
 }
 
@@ -1154,9 +1189,12 @@ void DebugReader::processDebugOutput()
     // Only update once per update at most
     //WatchView.Items.BeginUpdate;
 
-    if (mInvalidateAllVars) {
-         //invalidate all vars when there's first output
-         mDebugger->removeWatchVars(false);
+    // watch vars not displayed in the first output after the program runs
+    // are out of scope. gdb keeps their displays, and shows them again when
+    // they are back in scope, so they are not undisplayed.
+    bool updatingWatchVars = mInvalidateAllVars;
+    if (updatingWatchVars) {
+         mDisplayedWatchVars.clear();
          mInvalidateAllVars = false;
     }
 
@@ -1226,6 +1264,9 @@ void DebugReader::processDebugOutput()
        }
    } while (nextAnnotation != AnnotationType::TEOF);
 
+   if (updatingWatchVars)
+       emit watchVarsDisplayed(mDisplayedWatchVars);
+
      // Only update once per update at most
    //finally
      //WatchView.Items.EndUpdate;
@@ -1278,23 +1319,25 @@ QString DebugReader::processEvalOutput()
     return result;
 }
 
-void DebugReader::processWatchOutput(PWatchVar watchVar)
+void Debugger::processWatchOutput(PWatchVar watchVar, const QString& value)
 {
-//    // Expand if it was expanded or if it didn't have any children
-//    bool ParentWasExpanded = false;
-
     // Do not remove root node of watch variable
 
     watchVar->children.clear();
+    watchVar->pendingChildren.clear();
+    watchVar->childTokens.clear();
     watchVar->value = "";
-    // Process output parsed by ProcessEvalStruct
-    QString s = processEvalOutput();
+    watchVar->rawValue = value;
 
-    QStringList tokens = tokenize(s);
-    PWatchVar parentVar = watchVar;
-    PWatchVar currentVar = watchVar;
+    // Children are added to the watch model when the var is expanded, and
+    // structs and arrays inside them are only parsed at that time
+    parseWatchVarTokens(watchVar.get(),DebugReader::tokenize(value),watchVar->pendingChildren);
+        // TODO: remember expansion state
+}
 
-    QVector<PWatchVar> varStack;
+void parseWatchVarTokens(WatchVar *var, const QStringList &tokens, QList<PWatchVar> &children)
+{
+    WatchVar* currentVar = var;
     int i=0;
     while (i<tokens.length()) {
         QString token = tokens[i];
@@ -1303,45 +1346,47 @@ void DebugReader::processWatchOutput(PWatchVar watchVar)
                 || (ch>='A' && ch<='Z') || (ch>127)) {
             //is identifier,create new child node
             PWatchVar newVar = std::make_shared<WatchVar>();
-            newVar->parent = parentVar.get();
+            newVar->parent = var;
             newVar->name = token;
-            newVar->fullName = parentVar->fullName + '.'+token;
+            newVar->fullName = var->fullName + '.'+token;
             newVar->value = "";
             newVar->gdbIndex = -1;
-            parentVar->children.append(newVar);
-            currentVar = newVar;
+            children.append(newVar);
+            currentVar = newVar.get();
         } else if (ch == '{') {
-            if (parentVar->value.isEmpty()) {
-                parentVar->value = "{";
+            if (var->value.isEmpty()) {
+                var->value = "{";
             } else {
                 PWatchVar newVar = std::make_shared<WatchVar>();
-                newVar->parent = parentVar.get();
-                if (parentVar) {
-                    int count = parentVar->children.count();
-                    newVar->name = QString("[%1]").arg(count);
-                    newVar->fullName = parentVar->fullName + newVar->name;
-                } else {
-                    newVar->name = QString("[0]");
-                    newVar->fullName = newVar->name;
-                }
+                newVar->parent = var;
+                newVar->name = QString("[%1]").arg(children.count());
+                newVar->fullName = var->fullName + newVar->name;
                 newVar->value = "{";
-                parentVar->children.append(newVar);
-                varStack.push_back(parentVar);
-                parentVar = newVar;
+                newVar->gdbIndex = -1;
+                // keep the tokens up to the matching '}' for later
+                int level = 1;
+                i++;
+                while (i<tokens.length()) {
+                    if (tokens[i]=="{")
+                        level++;
+                    else if (tokens[i]=="}")
+                        level--;
+                    newVar->childTokens.append(tokens[i]);
+                    if (level==0)
+                        break;
+                    i++;
+                }
+                children.append(newVar);
             }
             currentVar = nullptr;
         } else if (ch == '}') {
             currentVar = nullptr;
             PWatchVar newVar = std::make_shared<WatchVar>();
-            newVar->parent = parentVar.get();
+            newVar->parent = var;
             newVar->name = "";
             newVar->value = "}";
             newVar->gdbIndex = -1;
-            parentVar->children.append(newVar);
-            if (!varStack.isEmpty()) {
-                parentVar = varStack.back();
-                varStack.pop_back();
-            }
+            children.append(newVar);
         } else if (ch == '=') {
             // just skip it
         } else if (ch == ',') {
@@ -1355,67 +1400,17 @@ void DebugReader::processWatchOutput(PWatchVar watchVar)
                 }
             } else {
                 PWatchVar newVar = std::make_shared<WatchVar>();
-                newVar->parent = parentVar.get();
+                newVar->parent = var;
                 newVar->name = QString("[%1]")
-                        .arg(parentVar->children.count());
-                newVar->fullName = parentVar->fullName + newVar->name;
+                        .arg(children.count());
+                newVar->fullName = var->fullName + newVar->name;
                 newVar->value = token;
                 newVar->gdbIndex = -1;
-                parentVar->children.append(newVar);
+                children.append(newVar);
             }
         }
         i++;
     }
-    // add placeholder name for variable name so we can format structs using one rule
-
-    // Add children based on indent
-//    QStringList lines = TextToLines(s);
-
-//    for (const QString& line:lines) {
-//        // Format node text. Remove trailing comma
-//        QString nodeText = line.trimmed();
-//        if (nodeText.endsWith(',')) {
-//            nodeText.remove(nodeText.length()-1,1);
-//        }
-
-//        if (nodeText.endsWith('{')) { // new member struct
-//            if (parentVar->text.isEmpty()) { // root node, replace text only
-//                parentVar->text = nodeText;
-//            } else {
-//                PWatchVar newVar = std::make_shared<WatchVar>();
-//                newVar->parent = parentVar.get();
-//                newVar->name = "";
-//                newVar->text = nodeText;
-//                newVar->gdbIndex = -1;
-//                parentVar->children.append(newVar);
-//                varStack.push_back(parentVar);
-//                parentVar = newVar;
-//            }
-//        } else if (nodeText.startsWith('}')) { // end of struct, change parent
-//                PWatchVar newVar = std::make_shared<WatchVar>();
-//                newVar->parent = parentVar.get();
-//                newVar->name = "";
-//                newVar->text = "}";
-//                newVar->gdbIndex = -1;
-//                parentVar->children.append(newVar);
-//                if (!varStack.isEmpty()) {
-//                    parentVar = varStack.back();
-//                    varStack.pop_back();
-//                }
-//        } else { // next parent member/child
-//            if (parentVar->text.isEmpty()) { // root node, replace text only
-//                parentVar->text = nodeText;
-//            } else {
-//                PWatchVar newVar = std::make_shared<WatchVar>();
-//                newVar->parent = parentVar.get();
-//                newVar->name = "";
-//                newVar->text = nodeText;
-//                newVar->gdbIndex = -1;
-//                parentVar->children.append(newVar);
-//            }
-//        }
-//    }
-        // TODO: remember expansion state
 }
 
 void DebugReader::runNextCmd()
@@ -1658,13 +1653,18 @@ void DebugReader::run()
                     });
     QByteArray buffer;
     QByteArray readed;
+    // position of the last #26 in buffer, so we don't rescan the whole
+    // buffer for the prompt each time new output arrives
+    int lastAnnotationPos = -1;
 
     mProcess->start();
     mProcess->waitForStarted(5000);
     mStartSemaphore.release(1);
 
     while (true) {
-        mProcess->waitForFinished(1);
+        // Block until gdb writes something instead of busy polling.
+        // Wake up regularly to check mStop and send the queued commands.
+        mProcess->waitForReadyRead(mCmdRunning?100:10);
         if (mProcess->state()!=QProcess::Running) {
             break;
         }
@@ -1679,17 +1679,22 @@ void DebugReader::run()
         if (errorOccurred)
             break;
         readed = mProcess->readAll();
-        buffer += readed;
-        if (getLastAnnotation(buffer) == AnnotationType::TPrompt) {
+        if (!readed.isEmpty()) {
+            int pos = readed.lastIndexOf(26);
+            if (pos>=0)
+                lastAnnotationPos = buffer.length()+pos;
+            buffer += readed;
+        }
+        if (lastAnnotationPos>=0
+                && getLastAnnotation(buffer,lastAnnotationPos) == AnnotationType::TPrompt) {
             mOutput = QString::fromLocal8Bit(buffer);
             processDebugOutput();
             buffer.clear();
+            lastAnnotationPos = -1;
             mCmdRunning = false;
             runNextCmd();
         } else if (!mCmdRunning && readed.isEmpty()){
             runNextCmd();
-        } else if (readed.isEmpty()){
-            msleep(1);
         }
     }
     if (errorOccurred) {
@@ -2086,6 +2091,46 @@ int WatchModel::columnCount(const QModelIndex&) const
     return 2;
 }
 
+bool WatchModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return !mWatchVars.isEmpty();
+    WatchVar* parentItem = static_cast<WatchVar*>(parent.internalPointer());
+    return !parentItem->children.isEmpty()
+            || !parentItem->pendingChildren.isEmpty()
+            || !parentItem->childTokens.isEmpty();
+}
+
+bool WatchModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return false;
+    WatchVar* parentItem = static_cast<WatchVar*>(parent.internalPointer());
+    return !parentItem->pendingChildren.isEmpty()
+            || !parentItem->childTokens.isEmpty();
+}
+
+void WatchModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid())
+        return;
+    WatchVar* parentItem = static_cast<WatchVar*>(parent.internalPointer());
+    if (!parentItem->childTokens.isEmpty()) {
+        parseWatchVarTokens(parentItem,parentItem->childTokens,parentItem->pendingChildren);
+        parentItem->childTokens.clear();
+    }
+    // add children of large arrays page by page
+    int count = std::min(parentItem->pendingChildren.count(),WATCH_CHILDREN_PAGE_SIZE);
+    if (count<=0)
+        return;
+    int row = parentItem->children.count();
+    beginInsertRows(parent,row,row+count-1);
+    parentItem->children.append(parentItem->pendingChildren.mid(0,count));
+    parentItem->pendingChildren.erase(parentItem->pendingChildren.begin(),
+                                      parentItem->pendingChildren.begin()+count);
+    endInsertRows();
+}
+
 void WatchModel::addWatchVar(PWatchVar watchVar)
 {
     for (PWatchVar var:mWatchVars) {
@@ -13,6 +13,9 @@
 #include <QSemaphore>
 #include <QThread>
 #include <memory>
+
+#define WATCH_CHILDREN_PAGE_SIZE 100
+
 enum class DebugCommandSource {
     Console,
     Other
@@ -54,11 +57,17 @@ struct WatchVar {
     QString name;
     QString value;
     QString fullName;
+    QString rawValue; // gdb output which value and children are parsed from
     int gdbIndex;
     QList<PWatchVar> children;
+    QStringList childTokens; // not parsed yet, parsed when expanded
+    QList<PWatchVar> pendingChildren; // parsed, but not added to children yet
     WatchVar * parent; //use raw point to prevent circular-reference
 };
 
+// Create the children of var from the tokens of its value
+void parseWatchVarTokens(WatchVar* var, const QStringList& tokens, QList<PWatchVar>& children);
+
 struct Breakpoint {
     int line;
     QString filename;
@@ -152,6 +161,9 @@ public:
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     void addWatchVar(PWatchVar watchVar);
     void removeWatchVar(const QString& name);
     void removeWatchVar(int gdbIndex);
@@ -254,10 +266,15 @@ private:
     void sendBreakpointCommand(PBreakpoint breakpoint);
     void sendClearBreakpointCommand(int index);
     void sendClearBreakpointCommand(PBreakpoint breakpoint);
+    void processWatchOutput(PWatchVar watchVar, const QString& value);
+    void resetWatchVarValue(PWatchVar var);
 
 private slots:
     void syncFinishedParsing();
     void onChangeDebugConsoleLastline(const QString& text);
+    void onWatchValueReady(const QString& name, int gdbIndex, const QString& value);
+    void onWatchVarInvalid(const QString& name);
+    void onWatchVarsDisplayed(const QStringList& names);
     void clearUpReader();
 
 private:
@@ -288,6 +305,8 @@ public:
     bool invalidateAllVars() const;
     void setInvalidateAllVars(bool invalidateAllVars);
 
+    static QStringList tokenize(const QString& s);
+
 signals:
     void parseStarted();
     void invalidateAllVars();
@@ -297,13 +316,16 @@ signals:
     void updateWatch();
     void processError(QProcess::ProcessError error);
     void changeDebugConsoleLastLine(const QString& text);
+    void watchValueReady(const QString& name, int gdbIndex, const QString& value);
+    void watchVarInvalid(const QString& name);
+    void watchVarsDisplayed(const QStringList& names);
     void cmdStarted();
     void cmdFinished();
 private:
     void clearCmdQueue();
     bool findAnnotation(AnnotationType annotation);
     AnnotationType getAnnotation(const QString& s);
-    AnnotationType getLastAnnotation(const QByteArray& text);
+    AnnotationType getLastAnnotation(const QByteArray& text, int annotationPos);
     AnnotationType getNextAnnotation();
     QString getNextFilledLine();
     QString getNextLine();
@@ -325,11 +347,9 @@ private:
     AnnotationType peekNextAnnotation();
     void processDebugOutput();
     QString processEvalOutput();
-    void processWatchOutput(PWatchVar WatchVar);
     void runNextCmd();
     void skipSpaces();
     void skipToAnnotation();
-    QStringList tokenize(const QString& s);
 private:
     Debugger *mDebugger;
     QString mDebuggerPath;
@@ -338,6 +358,7 @@ private:
     QQueue<PDebugCommand> mCmdQueue;
     int mUpdateCount;
     bool mInvalidateAllVars;
+    QStringList mDisplayedWatchVars; // names of the watch vars displayed after the program is resumed
 
     //fOnInvalidateAllVars: TInvalidateAllVarsEvent;
     bool mCmdRunning;
@@ -859,21 +859,50 @@ void Editor::onPreparePaintHighlightToken(int line, int aChar, const QString &to
 
 //    qDebug()<<token<<"-"<<attr->name()<<" - "<<line<<" : "<<aChar;
     if (mParser && highlighter() && (attr == highlighter()->identifierAttribute())) {
+        // don't wait for the parser while it's parsing (or busy starting a parse)
+        bool parsing = !mParser->tryFreeze();
+        auto action = finally([this,parsing]{
+            if (!parsing)
+                mParser->unFreeze();
+        });
+        // kinds found before are reused until the next parse is finished
+        if (!parsing && mParser->serialId()!=mStatementKindsSerialId) {
+            mStatementKinds.clear();
+            mStatementKindsSerialId = mParser->serialId();
+        }
         BufferCoord p{aChar,line};
         BufferCoord pBeginPos,pEndPos;
-        QString s= getWordAtPosition(this,p, pBeginPos,pEndPos, WordPurpose::wpInformation);
+        StatementKind kind = StatementKind::skUnknown;
+        const QString& lineText = lines()->getString(line-1);
+        auto iter = mStatementKinds.find(line);
+        if (iter!=mStatementKinds.end() && iter->text == lineText
+                && iter->kinds.contains(aChar)) {
+            kind = iter->kinds.value(aChar);
+        } else {
+            QString s= getWordAtPosition(this,p, pBeginPos,pEndPos, WordPurpose::wpInformation);
 //        qDebug()<<s;
-        PStatement statement = mParser->findStatementOf(mFilename,
-          s , p.Line);
-        StatementKind kind = mParser->getKindOfStatement(statement);
-        if (kind == StatementKind::skUnknown) {
-            if ((pEndPos.Line>=1)
-              && (pEndPos.Char>=0)
-              && (pEndPos.Char < lines()->getString(pEndPos.Line-1).length())
-              && (lines()->getString(pEndPos.Line-1)[pEndPos.Char] == '(')) {
-                kind = StatementKind::skFunction;
-            } else {
-                kind = StatementKind::skVariable;
+            if (!parsing) {
+                PStatement statement = mParser->findStatementOf(mFilename,
+                  s , p.Line);
+                kind = mParser->getKindOfStatement(statement);
+            }
+            if (kind == StatementKind::skUnknown) {
+                if ((pEndPos.Line>=1)
+                  && (pEndPos.Char>=0)
+                  && (pEndPos.Char < lines()->getString(pEndPos.Line-1).length())
+                  && (lines()->getString(pEndPos.Line-1)[pEndPos.Char] == '(')) {
+                    kind = StatementKind::skFunction;
+                } else {
+                    kind = StatementKind::skVariable;
+                }
+            }
+            if (!parsing) {
+                if (iter==mStatementKinds.end() || iter->text != lineText) {
+                    LineStatementKinds lineKinds;
+                    lineKinds.text = lineText;
+                    iter = mStatementKinds.insert(line,lineKinds);
+                }
+                iter->kinds.insert(aChar,kind);
             }
         }
         PColorSchemeItem item = pMainWindow->statementColors()->value(kind,PColorSchemeItem());
@@ -2322,6 +2351,7 @@ void Editor::showCompletion(bool autoComplete)
         mCompletionPopup->setCodeSnippets(pMainWindow->codeSnippetManager()->snippets());
     }
     mCompletionPopup->setIgnoreCase(pSettings->codeCompletion().ignoreCase());
+    mCompletionPopup->setFuzzyMatch(pSettings->codeCompletion().fuzzyMatch());
     mCompletionPopup->resize(pSettings->codeCompletion().width(),
                              pSettings->codeCompletion().height());
 //    fCompletionBox.CodeInsList := dmMain.CodeInserts.ItemList;
@@ -2348,7 +2378,8 @@ void Editor::showCompletion(bool autoComplete)
     if (word.isEmpty())
         word=getWordAtPosition(this,caretXY(),pBeginPos,pEndPos, WordPurpose::wpCompletion);
     //if not fCompletionBox.Visible then
-    mCompletionPopup->prepareSearch(word, mFilename, pBeginPos.Line);
+    mCompletionPopup->prepareSearch(word, mFilename, pBeginPos.Line,
+                                    getBlockSignature(pBeginPos.Line));
 
     // Filter the whole statement list
     if (mCompletionPopup->search(word, autoComplete)) { //only one suggestion and it's not input while typing
@@ -2356,6 +2387,37 @@ void Editor::showCompletion(bool autoComplete)
     }
 }
 
+// Identifies the blocks around the line without the parser: the lines opening
+// them, and the distance to the innermost one. It's unchanged when lines are
+// inserted or removed outside of the innermost block.
+QString Editor::getBlockSignature(int line)
+{
+    QStringList headers;
+    int offset = -1;
+    int level = 0; // unpaired '}' found so far
+    for (int i=line-2;i>=0;i--) {
+        const QString& s = lines()->getString(i);
+        for (int j=s.length()-1;j>=0;j--) {
+            if (s[j] == '}') {
+                level++;
+            } else if (s[j] == '{') {
+                if (level>0) {
+                    level--;
+                    continue;
+                }
+                if (offset<0)
+                    offset = line-1-i;
+                // the function header is on the previous line if '{' is alone
+                if (i>0)
+                    headers.append(lines()->getString(i-1).trimmed()+'\n'+s.trimmed());
+                else
+                    headers.append(s.trimmed());
+            }
+        }
+    }
+    return QString("%1\n%2").arg(offset).arg(headers.join('\n'));
+}
+
 void Editor::showHeaderCompletion(bool autoComplete)
 {
     if (!pSettings->codeCompletion().enabled())
@@ -23,6 +23,12 @@ struct TabStop {
 
 using PTabStop = std::shared_ptr<TabStop>;
 
+// kinds of the identifiers in a painted line, found by the parser
+struct LineStatementKinds {
+    QString text; // the line's text when the kinds are found
+    QHash<int,StatementKind> kinds; // start char of identifier -> kind
+};
+
 class SaveException: public std::exception {
 
 public:
@@ -203,6 +209,7 @@ private:
 
     void showCompletion(bool autoComplete);
     void showHeaderCompletion(bool autoComplete);
+    QString getBlockSignature(int line);
 
     bool testInFunc(int x,int y);
 
@@ -260,6 +267,8 @@ private:
     TipType mCurrentTipType;
     QString mOldHighlightedWord;
     QString mCurrentHighlightedWord;
+    QHash<int,LineStatementKinds> mStatementKinds; // line -> identifier kinds
+    QString mStatementKindsSerialId; // parser's serial id when they are found
 
     bool mSaving;
     bool mCurrentLineModified;
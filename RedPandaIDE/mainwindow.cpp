@@ -3069,6 +3069,10 @@ void MainWindow::closeProject(bool refreshEditor)
         } else
             mProject->saveLayout(); // always save layout, but not when SaveAll has been called
 
+        // don't keep searching the closed project's files
+        if (mSearchDialog)
+            mSearchDialog->cancelFindInFiles();
+
         mClassBrowserModel.beginUpdate();
         {
             auto action2 = finally([this]{
@@ -4060,7 +4064,14 @@ void MainWindow::onEndParsing(int total, int)
 {
     double parseTime = mParserTimer.elapsed() / 1000.0;
     double parsingFrequency;
-
+    CppParser* parser = qobject_cast<CppParser*>(sender());
+    QString queueInfo;
+    if (parser) {
+        double queuedTime = CppParserScheduler::instance()->queuedTime(parser) / 1000.0;
+        queueInfo = " "
+                + tr("(waited %1 seconds in queue, %2 parse requests pending)")
+                .arg(queuedTime).arg(CppParserScheduler::instance()->pendingCount());
+    }
 
     if (total > 1) {
         if (parseTime>0) {
@@ -4072,10 +4083,12 @@ void MainWindow::onEndParsing(int total, int)
                                   .arg(total).arg(parseTime)
                                   + " "
                                   + tr("(%1 files per second)")
-                                  .arg(parsingFrequency));
+                                  .arg(parsingFrequency)
+                                  + queueInfo);
     } else {
         updateStatusbarMessage(tr("Done parsing %1 files in %2 seconds")
-                                  .arg(total).arg(parseTime));
+                                  .arg(total).arg(parseTime)
+                               + queueInfo);
     }
 }
 
@@ -4,10 +4,13 @@
 
 #include <QApplication>
 #include <QDate>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QHash>
 #include <QQueue>
 #include <QThread>
 #include <QTime>
+#include <QtConcurrent>
 
 static QAtomicInt cppParserCount(0);
 CppParser::CppParser(QObject *parent) : QObject(parent)
@@ -27,10 +30,12 @@ CppParser::CppParser(QObject *parent) : QObject(parent)
     //mSkipList;
     mParseLocalHeaders = true;
     mParseGlobalHeaders = true;
+    mParallelParsing = true;
     mLockCount = 0;
     mIsSystemHeader = false;
     mIsHeader = false;
     mIsProjectFile = false;
+    mCachedSystemHeaderCount = 0;
 
     mCppKeywords = CppKeywords;
     mCppTypeKeywords = CppTypeKeywords;
@@ -500,6 +505,19 @@ bool CppParser::freeze(const QString &serialId)
     return true;
 }
 
+bool CppParser::tryFreeze()
+{
+    if (!mMutex.tryLock())
+        return false;
+    auto action = finally([this]{
+        mMutex.unlock();
+    });
+    if (mParsing)
+        return false;
+    mLockCount++;
+    return true;
+}
+
 QStringList CppParser::getClassesList()
 {
     QMutexLocker locker(&mMutex);
@@ -622,7 +640,9 @@ void CppParser::invalidateFile(const QString &fileName)
     }
     QSet<QString> files = calculateFilesToBeReparsed(fileName);
     internalInvalidateFiles(files);
+    mDetachedStatements.clear();
     mParsing = false;
+    CppParserScheduler::instance()->parserIdle(this);
 }
 
 bool CppParser::isIncludeLine(const QString &line)
@@ -648,14 +668,19 @@ bool CppParser::isSystemHeaderFile(const QString &fileName)
     return ::isSystemHeaderFile(fileName,mPreprocessor.includePaths());
 }
 
-void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
+bool CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
 {
     if (!mEnabled)
-        return;
+        return true;
     {
         QMutexLocker locker(&mMutex);
         if (mParsing || mLockCount>0)
-            return;
+            return false;
+        // nothing to do, keep the serial id so results cached with it stay valid
+        if (onlyIfNotParsed && mPreprocessor.scannedFiles().contains(fileName))
+            return true;
+        if (isFileUnchanged(fileName,inProject))
+            return true;
         updateSerialId();
         mParsing = true;
         if (updateView)
@@ -664,26 +689,31 @@ void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNo
     }
     {
         auto action = finally([&,this]{
+            mDetachedStatements.clear();
             mParsing = false;
 
             if (updateView)
                 emit onEndParsing(mFilesScannedCount,1);
             else
                 emit onEndParsing(mFilesScannedCount,0);
+            CppParserScheduler::instance()->parserIdle(this);
         });
-        QString fName = fileName;
-        if (onlyIfNotParsed && mPreprocessor.scannedFiles().contains(fName))
-            return;
-
-        QSet<QString> files = calculateFilesToBeReparsed(fileName);
-        internalInvalidateFiles(files);
-
         if (inProject)
             mProjectFiles.insert(fileName);
         else {
             mProjectFiles.remove(fileName);
         }
 
+        // only a function body is changed, files depending on it don't need reparse
+        if (incrementalParse(fileName)) {
+            mFilesToScanCount = 1;
+            mFilesScannedCount = 1;
+            return true;
+        }
+
+        QSet<QString> files = calculateFilesToBeReparsed(fileName);
+        internalInvalidateFiles(files);
+
         // Parse from disk or stream
         mFilesToScanCount = files.count();
         mFilesScannedCount = 0;
@@ -708,17 +738,19 @@ void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNo
                 }
             }
         }
+        saveSystemHeaderCache();
     }
+    return true;
 }
 
-void CppParser::parseFileList(bool updateView)
+bool CppParser::parseFileList(bool updateView)
 {
     if (!mEnabled)
-        return;
+        return true;
     {
         QMutexLocker locker(&mMutex);
         if (mParsing || mLockCount>0)
-            return;
+            return false;
         updateSerialId();
         mParsing = true;
         if (updateView)
@@ -727,28 +759,32 @@ void CppParser::parseFileList(bool updateView)
     }
     {
         auto action = finally([&,this]{
+            mDetachedStatements.clear();
             mParsing = false;
             if (updateView)
                 emit onEndParsing(mFilesScannedCount,1);
             else
                 emit onEndParsing(mFilesScannedCount,0);
+            CppParserScheduler::instance()->parserIdle(this);
         });
         // Support stopping of parsing when files closes unexpectedly
         mFilesScannedCount = 0;
         mFilesToScanCount = mFilesToScan.count();
+        QStringList files;
         // parse header files in the first parse
         foreach (const QString& file, mFilesToScan) {
-            if (isHfile(file)) {
-                mFilesScannedCount++;
-                emit onProgress(mCurrentFile,mFilesToScanCount,mFilesScannedCount);
-                if (!mPreprocessor.scannedFiles().contains(file)) {
-                    internalParse(file);
-                }
-            }
+            if (isHfile(file))
+                files.append(file);
         }
         //we only parse CFile in the second parse
         foreach (const QString& file,mFilesToScan) {
-            if (isCfile(file)) {
+            if (isCfile(file))
+                files.append(file);
+        }
+        if (mParallelParsing && files.count()>1 && QThread::idealThreadCount()>1) {
+            parseFilesInParallel(files);
+        } else {
+            foreach (const QString& file, files) {
                 mFilesScannedCount++;
                 emit onProgress(mCurrentFile,mFilesToScanCount,mFilesScannedCount);
                 if (!mPreprocessor.scannedFiles().contains(file)) {
@@ -757,7 +793,9 @@ void CppParser::parseFileList(bool updateView)
             }
         }
         mFilesToScan.clear();
+        saveSystemHeaderCache();
     }
+    return true;
 }
 
 void CppParser::parseHardDefines()
@@ -804,6 +842,12 @@ bool CppParser::parsing() const
     return mParsing;
 }
 
+bool CppParser::busy()
+{
+    QMutexLocker locker(&mMutex);
+    return mParsing || mLockCount>0;
+}
+
 void CppParser::reset()
 {
     while (true) {
@@ -851,17 +895,29 @@ void CppParser::reset()
 
         mNamespaces.clear();
         mInlineNamespaces.clear();
+        mStringPool.clear();
+        mFileBuffers.clear();
 
         mPreprocessor.clearProjectIncludePaths();
         mPreprocessor.clearIncludePaths();
         mProjectFiles.clear();
+        mCachedSystemHeaderCount = 0;
+        mSystemHeaderSnapshot.reset();
+        mDetachedStatements.clear();
     }
+    CppParserScheduler::instance()->parserIdle(this);
 }
 
 void CppParser::unFreeze()
 {
-    QMutexLocker locker(&mMutex);
-    mLockCount--;
+    {
+        QMutexLocker locker(&mMutex);
+        mLockCount--;
+        if (mLockCount>0)
+            return;
+    }
+    // outside of our lock, the scheduler never waits for it while holding its own
+    CppParserScheduler::instance()->parserIdle(this);
 }
 
 QSet<QString> CppParser::scannedFiles()
@@ -1032,7 +1088,7 @@ PStatement CppParser::addChildStatement(const PStatement& parent, const QString
                 isStatic);
 }
 
-PStatement CppParser::addStatement(const PStatement& parent,
+PStatement CppParser::addStatement(const PStatement& parentScope,
                                    const QString &fileName,
                                    const QString &hintText,
                                    const QString &aType,
@@ -1043,6 +1099,13 @@ PStatement CppParser::addStatement(const PStatement& parent,
                                    const StatementScope& scope,
                                    const StatementClassScope& classScope, bool isDefinition, bool isStatic)
 {
+    // the headers' statements are shared with other parsers, copy them before
+    // adding children or definitions to them
+    PStatement parent = detachedStatement(parentScope);
+    if (isSharedStatement(parent)) {
+        detachSystemHeaders();
+        parent = detachedStatement(parent);
+    }
     // Move '*', '&' to type rather than cmd (it's in the way for code-completion)
     QString newType = aType;
     QString newCommand = command;
@@ -1060,6 +1123,10 @@ PStatement CppParser::addStatement(const PStatement& parent,
         //find
         PStatement oldStatement = findStatementInScope(command,noNameArgs,kind,parent);
         if (oldStatement && isDefinition && !oldStatement->hasDefinition) {
+            if (isSharedStatement(oldStatement)) {
+                detachSystemHeaders();
+                oldStatement = detachedStatement(oldStatement);
+            }
             oldStatement->hasDefinition = true;
             if (oldStatement->fileName!=fileName) {
                 PFileIncludes fileIncludes1=mPreprocessor.includesList().value(fileName);
@@ -1074,16 +1141,16 @@ PStatement CppParser::addStatement(const PStatement& parent,
                 }
             }
             oldStatement->definitionLine = line;
-            oldStatement->definitionFileName = fileName;
+            oldStatement->definitionFileName = internString(fileName);
             return oldStatement;
         }
     }
     PStatement result = std::make_shared<Statement>();
     result->parentScope = parent;
     result->hintText = hintText;
-    result->type = newType;
+    result->type = internString(newType);
     if (!newCommand.isEmpty())
-        result->command = newCommand;
+        result->command = internString(newCommand);
     else {
         mUniqId++;
         result->command = QString("__STATEMENT__%1").arg(mUniqId);
@@ -1098,8 +1165,8 @@ PStatement CppParser::addStatement(const PStatement& parent,
     result->hasDefinition = isDefinition;
     result->line = line;
     result->definitionLine = line;
-    result->fileName = fileName;
-    result->definitionFileName = fileName;
+    result->fileName = internString(fileName);
+    result->definitionFileName = result->fileName;
     if (!fileName.isEmpty())
         result->inProject = mIsProjectFile;
     else
@@ -1135,6 +1202,17 @@ PStatement CppParser::addStatement(const PStatement& parent,
     return result;
 }
 
+QString CppParser::internString(const QString &s)
+{
+    if (s.isEmpty())
+        return s;
+    auto iter = mStringPool.constFind(s);
+    if (iter!=mStringPool.constEnd())
+        return *iter;
+    mStringPool.insert(s);
+    return s;
+}
+
 void CppParser::setInheritance(int index, const PStatement& classStatement, bool isStruct)
 {
     // Clear it. Assume it is assigned
@@ -3112,6 +3190,8 @@ void CppParser::internalParse(const QString &fileName)
     if (mOnGetFileStream) {
         mOnGetFileStream(fileName,buffer);
     }
+    if (!buffer.isEmpty())
+        mFileBuffers.insert(fileName,buffer);
 
     // Preprocess the file...
     {
@@ -3133,19 +3213,7 @@ void CppParser::internalParse(const QString &fileName)
         if (mTokenizer.tokenCount() == 0)
             return;
 
-        // Process the token list
-        mCurrentScope.clear();
-        mCurrentClassScope.clear();
-        mIndex = 0;
-        mClassScope = StatementClassScope::scsNone;
-        mSkipList.clear();
-        mBlockBeginSkips.clear();
-        mBlockEndSkips.clear();
-        mInlineNamespaceEndSkips.clear();
-        while(true) {
-            if (!handleStatement())
-                break;
-        }
+        handleTokens();
 #ifdef QT_DEBUG
 //        StringsToFile(mPreprocessor.result(),"f:\\preprocess.txt");
 //        mPreprocessor.dumpDefinesTo("f:\\defines.txt");
@@ -3157,6 +3225,302 @@ void CppParser::internalParse(const QString &fileName)
     }
 }
 
+bool CppParser::incrementalParse(const QString &fileName)
+{
+    if (!isCfile(fileName) && !isHfile(fileName))
+        return false;
+    // statements shared with other parsers are copied in the full reparse
+    if (isSharedFile(fileName))
+        return false;
+    QStringList oldBuffer = mFileBuffers.value(fileName);
+    if (oldBuffer.isEmpty() || !mPreprocessor.scannedFiles().contains(fileName))
+        return false;
+    PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
+    if (!fileIncludes)
+        return false;
+    QStringList buffer;
+    if (mOnGetFileStream) {
+        mOnGetFileStream(fileName,buffer);
+    }
+    if (buffer.isEmpty())
+        return false;
+
+    // Find the changed lines by comparing with the contents of the last parse
+    int oldCount = oldBuffer.count();
+    int newCount = buffer.count();
+    int prefix = 0;
+    while (prefix<oldCount && prefix<newCount && oldBuffer[prefix]==buffer[prefix])
+        prefix++;
+    // nothing changed in the file, so something else (like inProject) did
+    if (prefix == oldCount && prefix == newCount)
+        return false;
+    int suffix = 0;
+    while (suffix<oldCount-prefix && suffix<newCount-prefix
+           && oldBuffer[oldCount-1-suffix]==buffer[newCount-1-suffix])
+        suffix++;
+    int delta = newCount - oldCount;
+    int firstLine = prefix+1; // 1-based
+    int lastOldLine = oldCount - suffix; // < firstLine if lines are only inserted
+    int lastNewLine = lastOldLine + delta;
+    // preprocessor directives may change the rest of the file
+    for (int i=firstLine-1;i<lastOldLine;i++) {
+        if (oldBuffer[i].trimmed().startsWith('#'))
+            return false;
+    }
+    for (int i=firstLine-1;i<lastNewLine;i++) {
+        if (buffer[i].trimmed().startsWith('#'))
+            return false;
+    }
+
+    // Find the function body containing the changed lines
+    const QVector<PCppScope>& scopes = fileIncludes->scopes.scopes();
+    int index = -1;
+    for (int i=0;i<scopes.count();i++) {
+        if (scopes[i]->startLine > firstLine)
+            break;
+        index = i;
+    }
+    if (index<0)
+        return false;
+    PStatement functionStatement = scopes[index]->statement;
+    while (functionStatement
+           && functionStatement->kind != StatementKind::skFunction
+           && functionStatement->kind != StatementKind::skConstructor
+           && functionStatement->kind != StatementKind::skDestructor) {
+        if (functionStatement->kind != StatementKind::skBlock)
+            return false;
+        functionStatement = functionStatement->parentScope.lock();
+    }
+    if (!functionStatement)
+        return false;
+    auto inFunction=[&functionStatement](PStatement statement) {
+        while (statement) {
+            if (statement == functionStatement)
+                return true;
+            statement = statement->parentScope.lock();
+        }
+        return false;
+    };
+    int bodyStart = index;
+    while (bodyStart>0 && inFunction(scopes[bodyStart-1]->statement))
+        bodyStart--;
+    int bodyEnd = index+1;
+    while (bodyEnd<scopes.count() && inFunction(scopes[bodyEnd]->statement))
+        bodyEnd++;
+    if (bodyEnd>=scopes.count() || scopes[bodyStart]->statement!=functionStatement)
+        return false;
+    int startLine = scopes[bodyStart]->startLine;
+    int oldEndLine = scopes[bodyEnd]->startLine; // line of the closing '}'
+    PStatement outerScope = scopes[bodyEnd]->statement;
+    if (startLine>=firstLine || oldEndLine<=lastOldLine || oldEndLine<firstLine)
+        return false;
+
+    // Tokenize the new contents
+    mPreprocessor.includesList().remove(fileName);
+    mPreprocessor.setScanOptions(mParseGlobalHeaders, mParseLocalHeaders);
+    mPreprocessor.preprocess(fileName, buffer);
+    mPreprocessor.includesList().insert(fileName,fileIncludes);
+    mTokenizer.tokenize(mPreprocessor.result());
+    mPreprocessor.reset();
+    auto action = finally([this]{
+        mTokenizer.reset();
+    });
+
+    // The function body must still start before and end after the changed lines
+    QString currentFile;
+    int braceIndex = -1;
+    for (int i=0;i<mTokenizer.tokenCount();i++) {
+        const QString& text = mTokenizer[i]->text;
+        if (text.startsWith("#include ")) {
+            currentFile = text.mid(QString("#include ").length());
+            currentFile.truncate(currentFile.lastIndexOf(':'));
+        } else if (currentFile == fileName && mTokenizer[i]->line>=startLine
+                   && text.startsWith('{')) {
+            braceIndex = i;
+            break;
+        }
+    }
+    if (braceIndex<0 || mTokenizer[braceIndex]->line>=firstLine)
+        return false;
+    int closeIndex = skipBraces(braceIndex);
+    if (closeIndex == braceIndex
+            || mTokenizer[closeIndex]->line != oldEndLine + delta
+            || mTokenizer[closeIndex]->line <= lastNewLine)
+        return false;
+    for (int i=braceIndex;i<closeIndex;i++) {
+        if (mTokenizer[i]->text.startsWith("#include "))
+            return false;
+    }
+
+    // Remove statements in the old function body. Parameters and "this" are
+    // added with the function itself, so keep them.
+    StatementList bodyStatements;
+    QQueue<PStatement> queue;
+    foreach (const PStatement& child, functionStatement->children) {
+        if (child->fileName == fileName
+                && child->kind != StatementKind::skParameter
+                && child->command != "this")
+            queue.enqueue(child);
+    }
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        bodyStatements.append(statement);
+        foreach (const PStatement& child, statement->children) {
+            queue.enqueue(child);
+        }
+    }
+    foreach (const PStatement& statement, bodyStatements) {
+        mStatementList.deleteStatement(statement);
+        fileIncludes->statements.remove(statement->fullName,statement);
+        fileIncludes->declaredStatements.remove(statement->fullName,statement);
+    }
+
+    // Move statements after the function body, including the blocks and
+    // locals of other functions and the ends of scopes around the body
+    QSet<Statement*> movedStatements;
+    queue.clear();
+    foreach (const PStatement& statement, fileIncludes->statements) {
+        queue.enqueue(statement);
+    }
+    foreach (const PStatement& statement, fileIncludes->declaredStatements) {
+        queue.enqueue(statement);
+    }
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        if (movedStatements.contains(statement.get()))
+            continue;
+        movedStatements.insert(statement.get());
+        if (statement->fileName == fileName) {
+            if (statement->line >= oldEndLine)
+                statement->line += delta;
+            if (statement->endLine >= oldEndLine)
+                statement->endLine += delta;
+        }
+        if (statement->definitionFileName == fileName) {
+            if (statement->definitionLine >= oldEndLine)
+                statement->definitionLine += delta;
+            if (statement->definitionEndLine >= oldEndLine)
+                statement->definitionEndLine += delta;
+        }
+        foreach (const PStatement& child, statement->children) {
+            if (child->fileName == fileName || child->definitionFileName == fileName)
+                queue.enqueue(child);
+        }
+    }
+    QVector<PCppScope> scopesAfter = scopes.mid(bodyEnd+1);
+    fileIncludes->scopes.truncate(bodyStart);
+
+    // Parse the new function body
+    mCurrentFile = fileName;
+    mIsSystemHeader = isSystemHeaderFile(mCurrentFile) || isProjectHeaderFile(mCurrentFile);
+    mIsProjectFile = mProjectFiles.contains(mCurrentFile);
+    mIsHeader = isHfile(mCurrentFile);
+    mCurrentScope.clear();
+    mCurrentClassScope.clear();
+    mSkipList.clear();
+    mBlockBeginSkips.clear();
+    mBlockEndSkips.clear();
+    mInlineNamespaceEndSkips.clear();
+    mCurrentScope.append(outerScope);
+    mCurrentClassScope.append(StatementClassScope::scsNone);
+    mClassScope = StatementClassScope::scsNone;
+    addSoloScopeLevel(functionStatement,startLine);
+    mIndex = braceIndex+1;
+    while (mIndex<=closeIndex && mCurrentScope.count()>1) {
+        if (!handleStatement())
+            break;
+    }
+    // function body is not correctly closed, the whole file must be reparsed
+    if (mCurrentScope.count()>1)
+        return false;
+    mCurrentScope.clear();
+    mCurrentClassScope.clear();
+    foreach (const PCppScope& scope, scopesAfter) {
+        fileIncludes->scopes.addScope(scope->startLine+delta,scope->statement);
+    }
+    mFileBuffers.insert(fileName,buffer);
+    return true;
+}
+
+bool CppParser::isFileUnchanged(const QString &fileName, bool inProject)
+{
+    if (!mPreprocessor.scannedFiles().contains(fileName)
+            || mProjectFiles.contains(fileName)!=inProject)
+        return false;
+    QStringList oldBuffer = mFileBuffers.value(fileName);
+    if (oldBuffer.isEmpty())
+        return false;
+    QStringList buffer;
+    if (mOnGetFileStream) {
+        mOnGetFileStream(fileName,buffer);
+    }
+    return buffer == oldBuffer;
+}
+
+void CppParser::handleTokens()
+{
+    // Process the token list
+    mCurrentScope.clear();
+    mCurrentClassScope.clear();
+    mIndex = 0;
+    mClassScope = StatementClassScope::scsNone;
+    mSkipList.clear();
+    mBlockBeginSkips.clear();
+    mBlockEndSkips.clear();
+    mInlineNamespaceEndSkips.clear();
+    while(true) {
+        if (!handleStatement())
+            break;
+    }
+}
+
+void CppParser::parseFilesInParallel(const QStringList &files)
+{
+    // Preprocessing fills the include/define infos shared by all files, so files are
+    // preprocessed one by one in order; the tokenizer only needs the preprocessed text,
+    // so tokenizing runs in the thread pool meanwhile.
+    // Statements are added to the model in the same order as parsing files one by one,
+    // as soon as the tokens are ready. Only a few token lists are waiting at a time.
+    int maxPending = std::max(QThread::idealThreadCount(),1)*2;
+    QQueue<QFuture<CppTokenizer::TokenList>> tokenizeResults;
+    auto handleTokenizeResult = [this](const QFuture<CppTokenizer::TokenList>& future) {
+        mTokenizer.setTokens(future.result());
+        if (mTokenizer.tokenCount()>0)
+            handleTokens();
+        mTokenizer.reset();
+    };
+    for (int i=0;i<files.count();i++) {
+        const QString& file = files[i];
+        mFilesScannedCount++;
+        emit onProgress(file,mFilesToScanCount,mFilesScannedCount);
+        if (mPreprocessor.scannedFiles().contains(file))
+            continue;
+        QStringList buffer;
+        if (mOnGetFileStream) {
+            mOnGetFileStream(file,buffer);
+        }
+        if (!buffer.isEmpty())
+            mFileBuffers.insert(file,buffer);
+        mPreprocessor.setScanOptions(mParseGlobalHeaders, mParseLocalHeaders);
+        mPreprocessor.preprocess(file, buffer);
+        QStringList preprocessResult = mPreprocessor.result();
+        mPreprocessor.reset();
+        tokenizeResults.enqueue(QtConcurrent::run([preprocessResult]() {
+            CppTokenizer tokenizer;
+            tokenizer.tokenize(preprocessResult);
+            return tokenizer.tokens();
+        }));
+        while (!tokenizeResults.isEmpty()
+               && (tokenizeResults.head().isFinished()
+                   || tokenizeResults.count()>maxPending)) {
+            handleTokenizeResult(tokenizeResults.dequeue());
+        }
+    }
+    while (!tokenizeResults.isEmpty()) {
+        handleTokenizeResult(tokenizeResults.dequeue());
+    }
+}
+
 void CppParser::inheritClassStatement(const PStatement& derived, bool isStruct,
                                       const PStatement& base, StatementClassScope access)
 {
@@ -3361,6 +3725,7 @@ void CppParser::internalInvalidateFile(const QString &fileName)
     }
     // delete it from scannedfiles
     mPreprocessor.scannedFiles().remove(fileName);
+    mFileBuffers.remove(fileName);
 
     // remove its include files list
     PFileIncludes p = findFileIncludes(fileName, true);
@@ -3392,8 +3757,21 @@ void CppParser::internalInvalidateFile(const QString &fileName)
 
 void CppParser::internalInvalidateFiles(const QSet<QString> &files)
 {
+    for (const QString& file:files) {
+        if (isSharedFile(file)) {
+            detachSystemHeaders();
+            break;
+        }
+    }
     for (const QString& file:files)
         internalInvalidateFile(file);
+    // drop the pooled strings only used by the removed statements
+    for (auto iter=mStringPool.begin();iter!=mStringPool.end();) {
+        if (iter->isDetached())
+            iter = mStringPool.erase(iter);
+        else
+            ++iter;
+    }
 }
 
 QSet<QString> CppParser::calculateFilesToBeReparsed(const QString &fileName)
@@ -3785,6 +4163,7 @@ bool CppParser::isTypeStatement(StatementKind kind)
 
 void CppParser::updateSerialId()
 {
+    mSerialCount++;
     mSerialId = QString("%1 %2").arg(mParserId).arg(mSerialCount);
 }
 
@@ -3793,6 +4172,253 @@ const StatementModel &CppParser::statementList() const
     return mStatementList;
 }
 
+bool CppParser::parallelParsing() const
+{
+    return mParallelParsing;
+}
+
+void CppParser::setParallelParsing(bool newParallelParsing)
+{
+    mParallelParsing = newParallelParsing;
+}
+
+const QString &CppParser::systemHeaderCacheDir() const
+{
+    return mSystemHeaderCacheDir;
+}
+
+void CppParser::setSystemHeaderCacheDir(const QString &newSystemHeaderCacheDir)
+{
+    QMutexLocker locker(&mMutex);
+    mSystemHeaderCacheDir = newSystemHeaderCacheDir;
+}
+
+bool CppParser::loadSystemHeaderCache()
+{
+    QMutexLocker locker(&mMutex);
+    if (mParsing || mSystemHeaderCacheDir.isEmpty())
+        return false;
+    QString key = systemHeaderCacheKey();
+    // use the headers already loaded by other parsers for the compiler set
+    PSystemHeaderSnapshot snapshot = SystemHeaderCache::shared(key);
+    if (!snapshot) {
+        snapshot = SystemHeaderCache::load(
+                    SystemHeaderCache::cacheFileName(mSystemHeaderCacheDir,key),
+                    key);
+        if (!snapshot)
+            return false;
+        SystemHeaderCache::share(snapshot);
+    }
+    importSystemHeaders(snapshot);
+    mSystemHeaderSnapshot = snapshot;
+    return true;
+}
+
+QString CppParser::systemHeaderCacheKey()
+{
+    return SystemHeaderCache::calculateKey(mPreprocessor.includePathList(),
+                                           mPreprocessor.hardDefines(),
+                                           mParseGlobalHeaders);
+}
+
+bool CppParser::isCachableHeader(const QString &fileName)
+{
+    // only headers in the compiler set's include dirs are cached
+    foreach (const QString& path, mPreprocessor.includePathList()) {
+        if (fileName.startsWith(path))
+            return true;
+    }
+    return false;
+}
+
+PSystemHeaderSnapshot CppParser::exportSystemHeaders(const QString &key)
+{
+    PSystemHeaderSnapshot snapshot = std::make_shared<SystemHeaderSnapshot>();
+    snapshot->key = key;
+    snapshot->uniqId = mUniqId;
+    foreach (const QString& file, mPreprocessor.scannedFiles()) {
+        if (!isCachableHeader(file))
+            continue;
+        snapshot->fileTimes.insert(file,QFileInfo(file).lastModified().toMSecsSinceEpoch());
+        // the maps and include infos are still changed by us, share copies of them
+        PDefineMap defineMap = mPreprocessor.fileDefines().value(file,PDefineMap());
+        if (defineMap)
+            snapshot->fileDefines.insert(file,std::make_shared<DefineMap>(*defineMap));
+        PFileIncludes fileIncludes = mPreprocessor.includesList().value(file,PFileIncludes());
+        if (fileIncludes)
+            snapshot->includes.insert(file,std::make_shared<FileIncludes>(*fileIncludes));
+    }
+    foreach (const PStatement& statement, mStatementList.childrenStatements()) {
+        if (snapshot->fileTimes.contains(statement->fileName))
+            snapshot->statements.append(statement);
+    }
+    snapshot->inlineNamespaces = mInlineNamespaces;
+    return snapshot;
+}
+
+void CppParser::importSystemHeaders(const PSystemHeaderSnapshot &snapshot)
+{
+    // the define maps and include infos are changed when other files are
+    // parsed, use our own (implicitly shared) copies of them. The statements
+    // are shared, see detachSystemHeaders().
+    for (auto iter=snapshot->fileDefines.cbegin();iter!=snapshot->fileDefines.cend();++iter) {
+        mPreprocessor.fileDefines().insert(iter.key(),std::make_shared<DefineMap>(*iter.value()));
+    }
+    for (auto iter=snapshot->includes.cbegin();iter!=snapshot->includes.cend();++iter) {
+        mPreprocessor.includesList().insert(iter.key(),std::make_shared<FileIncludes>(*iter.value()));
+    }
+    foreach (const QString& file, snapshot->fileTimes.keys()) {
+        mPreprocessor.scannedFiles().insert(file);
+    }
+    QQueue<PStatement> queue;
+    foreach (const PStatement& statement, snapshot->statements) {
+        mStatementList.add(statement);
+        queue.enqueue(statement);
+    }
+    // register namespaces declared in the headers
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        if (statement->kind == StatementKind::skNamespace) {
+            PStatementList namespaceList = mNamespaces.value(statement->fullName,PStatementList());
+            if (!namespaceList) {
+                namespaceList=std::make_shared<StatementList>();
+                mNamespaces.insert(statement->fullName,namespaceList);
+            }
+            namespaceList->append(statement);
+        }
+        foreach (const PStatement& child, statement->children) {
+            queue.enqueue(child);
+        }
+    }
+    mInlineNamespaces.unite(snapshot->inlineNamespaces);
+    mUniqId = qMax(mUniqId,snapshot->uniqId);
+    mCachedSystemHeaderCount = snapshot->fileTimes.count();
+}
+
+void CppParser::saveSystemHeaderCache()
+{
+    if (mSystemHeaderCacheDir.isEmpty())
+        return;
+    int count = 0;
+    foreach (const QString& file, mPreprocessor.scannedFiles()) {
+        if (isCachableHeader(file))
+            count++;
+    }
+    //no new system headers parsed since the cache is loaded/saved
+    if (count <= mCachedSystemHeaderCount)
+        return;
+    QString key = systemHeaderCacheKey();
+    PSystemHeaderSnapshot snapshot = exportSystemHeaders(key);
+    if (SystemHeaderCache::save(SystemHeaderCache::cacheFileName(mSystemHeaderCacheDir,key),
+                                snapshot))
+        mCachedSystemHeaderCount = count;
+    // members and definitions in our own code are added to the headers'
+    // statements, other parsers must not see them
+    QQueue<PStatement> queue;
+    foreach (const PStatement& statement, snapshot->statements) {
+        queue.enqueue(statement);
+    }
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        if (!snapshot->fileTimes.contains(statement->fileName)
+                || !snapshot->fileTimes.contains(statement->definitionFileName))
+            return;
+        foreach (const PStatement& child, statement->children) {
+            queue.enqueue(child);
+        }
+    }
+    // parsers created later can use our results. The statements in the
+    // snapshot are ours, from now on we copy them before changing them too.
+    SystemHeaderCache::share(snapshot);
+    mSystemHeaderSnapshot = snapshot;
+}
+
+bool CppParser::isSharedStatement(const PStatement &statement)
+{
+    return statement && mSystemHeaderSnapshot
+            && mSystemHeaderSnapshot->fileTimes.contains(statement->fileName);
+}
+
+bool CppParser::isSharedFile(const QString &fileName)
+{
+    if (!mSystemHeaderSnapshot)
+        return false;
+    if (mSystemHeaderSnapshot->fileTimes.contains(fileName))
+        return true;
+    // definitions or members of shared statements in the file
+    PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
+    if (!fileIncludes)
+        return false;
+    foreach (const PStatement& statement, fileIncludes->statements) {
+        if (isSharedStatement(statement)
+                || isSharedStatement(statement->parentScope.lock()))
+            return true;
+    }
+    return false;
+}
+
+PStatement CppParser::detachedStatement(const PStatement &statement)
+{
+    if (!statement)
+        return statement;
+    PStatement copy = mDetachedStatements.value(statement.get());
+    return copy?copy:statement;
+}
+
+void CppParser::detachSystemHeaders()
+{
+    if (!mSystemHeaderSnapshot)
+        return;
+    const StatementList& oldStatements = mSystemHeaderSnapshot->statements;
+    QHash<Statement*,PStatement> copies;
+    StatementList statements = SystemHeaderCache::copyStatements(oldStatements,copies);
+    for (int i=0;i<oldStatements.count();i++) {
+        mStatementList.deleteStatement(oldStatements[i]);
+        mStatementList.add(statements[i]);
+    }
+    mSystemHeaderSnapshot.reset();
+    mDetachedStatements = copies;
+
+    // point our other references to the copies
+    foreach (const PStatementList& namespaceList, mNamespaces) {
+        for (int i=0;i<namespaceList->count();i++) {
+            (*namespaceList)[i] = detachedStatement(namespaceList->at(i));
+        }
+    }
+    foreach (const PFileIncludes& fileIncludes, mPreprocessor.includesList()) {
+        for (auto iter=fileIncludes->statements.begin();iter!=fileIncludes->statements.end();++iter) {
+            iter.value() = detachedStatement(iter.value());
+        }
+        for (auto iter=fileIncludes->declaredStatements.begin();iter!=fileIncludes->declaredStatements.end();++iter) {
+            iter.value() = detachedStatement(iter.value());
+        }
+        QVector<PCppScope> scopes = fileIncludes->scopes.scopes();
+        fileIncludes->scopes.clear();
+        foreach (const PCppScope& scope, scopes) {
+            fileIncludes->scopes.addScope(scope->startLine,detachedStatement(scope->statement));
+        }
+    }
+    // classes in our own code may inherit from the headers' classes
+    QSet<Statement*> detached;
+    foreach (const PStatement& statement, statements) {
+        detached.insert(statement.get());
+    }
+    QQueue<PStatement> queue;
+    foreach (const PStatement& statement, mStatementList.childrenStatements()) {
+        if (!detached.contains(statement.get()))
+            queue.enqueue(statement);
+    }
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        for (int i=0;i<statement->inheritanceList.count();i++) {
+            statement->inheritanceList[i] = detachedStatement(statement->inheritanceList[i].lock());
+        }
+        foreach (const PStatement& child, statement->children) {
+            queue.enqueue(child);
+        }
+    }
+}
+
 bool CppParser::parseGlobalHeaders() const
 {
     return mParseGlobalHeaders;
@@ -3858,42 +4484,137 @@ void CppParser::setEnabled(bool newEnabled)
     mEnabled = newEnabled;
 }
 
-CppFileParserThread::CppFileParserThread(
-        PCppParser parser,
-        QString fileName,
-        bool inProject,
-        bool onlyIfNotParsed,
-        bool updateView,
-        QObject *parent):QThread(parent),
-    mParser(parser),
-    mFileName(fileName),
-    mInProject(inProject),
-    mOnlyIfNotParsed(onlyIfNotParsed),
-    mUpdateView(updateView)
+CppParserScheduler *CppParserScheduler::instance()
 {
+    // not deleted, so quitting doesn't wait for the running parses
+    static CppParserScheduler* scheduler = new CppParserScheduler();
+    return scheduler;
+}
 
+CppParserScheduler::CppParserScheduler()
+{
+    mPool.setMaxThreadCount(std::max(QThread::idealThreadCount(),2));
 }
 
-void CppFileParserThread::run()
+void CppParserScheduler::schedule(const CppParseRequest &request)
 {
-    if (mParser && !mParser->parsing()) {
-        mParser->parseFile(mFileName,mInProject,mOnlyIfNotParsed,mUpdateView);
+    if (!request.parser)
+        return;
+    QMutexLocker locker(&mMutex);
+    QList<CppParseRequest>& requests = mPendingRequests[request.parser.get()];
+    // the newest request for the same file(s) wins
+    for (int i=requests.count()-1;i>=0;i--) {
+        const CppParseRequest& oldRequest = requests[i];
+        if (oldRequest.isFileList == request.isFileList
+                && oldRequest.fileName == request.fileName)
+            requests.removeAt(i);
+    }
+    requests.append(request);
+    requests.last().queuedTimer.start();
+    if (mRunningParsers.contains(request.parser.get())
+            || mWaitingParsers.contains(request.parser.get()))
+        return;
+    startRequests(request.parser, request.isFileList?0:1);
+}
+
+void CppParserScheduler::parserIdle(CppParser *parser)
+{
+    QMutexLocker locker(&mMutex);
+    PCppParser waitingParser = mWaitingParsers.take(parser);
+    if (!waitingParser)
+        return;
+    int priority = 0;
+    foreach (const CppParseRequest& request, mPendingRequests.value(parser)) {
+        if (!request.isFileList) {
+            priority = 1;
+            break;
+        }
     }
+    startRequests(waitingParser, priority);
 }
 
-CppFileListParserThread::CppFileListParserThread(PCppParser parser,
-                                                 bool updateView, QObject *parent):
-    QThread(parent),
-    mParser(parser),
-    mUpdateView(updateView)
+int CppParserScheduler::pendingCount()
 {
+    QMutexLocker locker(&mMutex);
+    int count = 0;
+    foreach (const QList<CppParseRequest>& requests, mPendingRequests)
+        count += requests.count();
+    return count;
+}
 
+qint64 CppParserScheduler::queuedTime(CppParser *parser)
+{
+    QMutexLocker locker(&mMutex);
+    return mQueuedTimes.value(parser,0);
+}
+
+void CppParserScheduler::startRequests(PCppParser parser, int priority)
+{
+    // called with mMutex locked
+    mRunningParsers.insert(parser.get());
+    mPool.start([this,parser]{
+        runRequests(parser);
+    }, priority);
 }
 
-void CppFileListParserThread::run()
+void CppParserScheduler::runRequests(PCppParser parser)
 {
-    if (mParser && !mParser->parsing()) {
-        mParser->parseFileList(mUpdateView);
+    while (true) {
+        CppParseRequest request;
+        {
+            QMutexLocker locker(&mMutex);
+            QList<CppParseRequest>& requests = mPendingRequests[parser.get()];
+            if (requests.isEmpty()) {
+                mPendingRequests.remove(parser.get());
+                mRunningParsers.remove(parser.get());
+                return;
+            }
+            int index = 0;
+            while (index<requests.count() && requests[index].isFileList)
+                index++;
+            if (index>=requests.count())
+                index = 0;
+            request = requests.takeAt(index);
+            mQueuedTimes.insert(parser.get(),request.queuedTimer.elapsed());
+        }
+        bool done;
+        if (request.isFileList) {
+            done = parser->parseFileList(request.updateView);
+        } else {
+            done = parser->parseFile(request.fileName,request.inProject,
+                              request.onlyIfNotParsed,request.updateView);
+        }
+        if (done)
+            continue;
+        // the parser is parsing (not started by us) or frozen,
+        // put the request back unless a newer one replaced it,
+        // and leave the pool thread until parserIdle() is called
+        {
+            QMutexLocker locker(&mMutex);
+            QList<CppParseRequest>& requests = mPendingRequests[parser.get()];
+            bool replaced = false;
+            foreach (const CppParseRequest& newRequest, requests) {
+                if (newRequest.isFileList == request.isFileList
+                        && newRequest.fileName == request.fileName) {
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced)
+                requests.prepend(request);
+            mRunningParsers.remove(parser.get());
+            mWaitingParsers.insert(parser.get(),parser);
+        }
+        // the parser may have become idle before we started waiting
+        if (parser->busy())
+            return;
+        {
+            QMutexLocker locker(&mMutex);
+            // parserIdle() was called and started another run
+            if (!mWaitingParsers.remove(parser.get()))
+                return;
+            mRunningParsers.insert(parser.get());
+        }
     }
 }
 
@@ -3901,22 +4622,25 @@ void parseFile(PCppParser parser, const QString& fileName, bool inProject, bool
 {
     if (!parser)
         return;
-    CppFileParserThread* thread = new CppFileParserThread(parser,fileName,inProject,onlyIfNotParsed,updateView);
-    thread->connect(thread,
-                    &QThread::finished,
-                    thread,
-                    &QThread::deleteLater);
-    thread->start();
+    CppParseRequest request;
+    request.parser = parser;
+    request.isFileList = false;
+    request.fileName = fileName;
+    request.inProject = inProject;
+    request.onlyIfNotParsed = onlyIfNotParsed;
+    request.updateView = updateView;
+    CppParserScheduler::instance()->schedule(request);
 }
 
 void parseFileList(PCppParser parser, bool updateView)
 {
     if (!parser)
         return;
-    CppFileListParserThread *thread = new CppFileListParserThread(parser,updateView);
-    thread->connect(thread,
-                    &QThread::finished,
-                    thread,
-                    &QThread::deleteLater);
-    thread->start();
+    CppParseRequest request;
+    request.parser = parser;
+    request.isFileList = true;
+    request.inProject = true;
+    request.onlyIfNotParsed = false;
+    request.updateView = updateView;
+    CppParserScheduler::instance()->schedule(request);
 }
@@ -4,9 +4,12 @@
 #include <QMutex>
 #include <QObject>
 #include <QThread>
+#include <QThreadPool>
+#include <QElapsedTimer>
 #include "statementmodel.h"
 #include "cpptokenizer.h"
 #include "cpppreprocessor.h"
+#include "systemheadercache.h"
 
 class CppParser : public QObject
 {
@@ -59,6 +62,7 @@ public:
                                     const PStatement& currentClass);
     bool freeze();  // Freeze/Lock (stop reparse while searching)
     bool freeze(const QString& serialId);  // Freeze/Lock (stop reparse while searching)
+    bool tryFreeze(); // like freeze(), but returns false instead of waiting for the lock
     QStringList getClassesList();
     QSet<QString> getFileDirectIncludes(const QString& filename);
     QSet<QString> getFileIncludes(const QString& filename);
@@ -70,11 +74,14 @@ public:
     bool isIncludeLine(const QString &line);
     bool isProjectHeaderFile(const QString& fileName);
     bool isSystemHeaderFile(const QString& fileName);
-    void parseFile(const QString& fileName, bool inProject,
+    // parseFile() and parseFileList() return false if the parser is parsing
+    // or frozen, and the request is not run
+    bool parseFile(const QString& fileName, bool inProject,
                    bool onlyIfNotParsed = false, bool updateView = true);
-    void parseFileList(bool updateView = true);
+    bool parseFileList(bool updateView = true);
     void parseHardDefines();
     bool parsing() const;
+    bool busy(); // parsing or frozen
     void reset();
     void unFreeze(); // UnFree/UnLock (reparse while searching)
     QSet<QString> scannedFiles();
@@ -127,6 +134,14 @@ public:
 
     const StatementModel &statementList() const;
 
+    bool parallelParsing() const;
+    void setParallelParsing(bool newParallelParsing);
+
+    const QString &systemHeaderCacheDir() const;
+    void setSystemHeaderCacheDir(const QString &newSystemHeaderCacheDir);
+    // restore parse results of the compiler set's headers from the disk cache
+    bool loadSystemHeaderCache();
+
 signals:
     void onProgress(const QString& fileName, int total, int current);
     void onBusy();
@@ -167,6 +182,7 @@ private:
             const StatementClassScope& classScope,
             bool isDefinition,
             bool isStatic);
+    QString internString(const QString& s);
     void setInheritance(int index, const PStatement& classStatement, bool isStruct);
     bool isCurrentScope(const QString& command);
     void addSoloScopeLevel(PStatement& statement, int line); // adds new solo level
@@ -257,6 +273,10 @@ private:
     void handleUsing();
     void handleVar();
     void internalParse(const QString& fileName);
+    bool incrementalParse(const QString& fileName);
+    bool isFileUnchanged(const QString& fileName, bool inProject);
+    void handleTokens();
+    void parseFilesInParallel(const QStringList& files);
 //    function FindMacroDefine(const Command: AnsiString): PStatement;
     void inheritClassStatement(
             const PStatement& derived,
@@ -325,6 +345,16 @@ private:
 
     void updateSerialId();
 
+    QString systemHeaderCacheKey();
+    bool isCachableHeader(const QString& fileName);
+    PSystemHeaderSnapshot exportSystemHeaders(const QString& key);
+    void importSystemHeaders(const PSystemHeaderSnapshot& snapshot);
+    void saveSystemHeaderCache();
+    bool isSharedStatement(const PStatement& statement);
+    bool isSharedFile(const QString& fileName);
+    PStatement detachedStatement(const PStatement& statement);
+    void detachSystemHeaders();
+
 
 private:
     int mParserId;
@@ -360,58 +390,61 @@ private:
     int mFilesToScanCount; // count of files and files included in files that have to be scanned
     bool mParseLocalHeaders;
     bool mParseGlobalHeaders;
+    bool mParallelParsing;
     bool mIsProjectFile;
     //fMacroDefines : TList;
     int mLockCount; // lock(don't reparse) when we need to find statements in a batch
     bool mParsing;
     QHash<QString,PStatementList> mNamespaces;  //TStringList<String,List<Statement>> namespace and the statements in its scope
+    QHash<QString,QStringList> mFileBuffers; // contents of the opened files when they are parsed
     QSet<QString> mInlineNamespaces;
+    QSet<QString> mStringPool; // shared copies of file names, types and commands used by statements
     //fRemovedStatements: THashedStringList; //THashedStringList<String,PRemovedStatements>
 
     QRecursiveMutex mMutex;
     GetFileStreamCallBack mOnGetFileStream;
     QMap<QString,SkipType> mCppKeywords;
     QSet<QString> mCppTypeKeywords;
+    QString mSystemHeaderCacheDir;
+    int mCachedSystemHeaderCount; // count of system headers in the loaded/saved cache
+    PSystemHeaderSnapshot mSystemHeaderSnapshot; // shared snapshot whose statements we use, read only
+    QHash<Statement*,PStatement> mDetachedStatements; // shared statement -> our copy, during the parse that copied them
 };
 using PCppParser = std::shared_ptr<CppParser>;
 
-class CppFileParserThread : public QThread {
-    Q_OBJECT
-public:
-    explicit CppFileParserThread(
-            PCppParser parser,
-            QString fileName,
-            bool inProject,
-            bool onlyIfNotParsed = false,
-            bool updateView = true,
-            QObject *parent = nullptr);
-
-private:
-    PCppParser mParser;
-    QString mFileName;
-    bool mInProject;
-    bool mOnlyIfNotParsed;
-    bool mUpdateView;
-
-    // QThread interface
-protected:
-    void run() override;
+struct CppParseRequest {
+    PCppParser parser;
+    bool isFileList; // parse the parser's file list instead of fileName
+    QString fileName;
+    bool inProject;
+    bool onlyIfNotParsed;
+    bool updateView;
+    QElapsedTimer queuedTimer; // started when the request is scheduled
 };
-using PCppParserThread = std::shared_ptr<CppFileParserThread>;
 
-class CppFileListParserThread: public QThread {
-    Q_OBJECT
+// Runs the parse requests in a thread pool. Requests of the same parser are
+// run one by one; a pending request is replaced by a newer one for the same
+// file (or file list), and single files are parsed before file lists.
+// While the parser is parsing or frozen, its requests wait without holding
+// a pool thread, and are resumed by parserIdle().
+class CppParserScheduler {
 public:
-    explicit CppFileListParserThread(
-            PCppParser parser,
-            bool updateView = true,
-            QObject *parent = nullptr);
+    static CppParserScheduler* instance();
+    void schedule(const CppParseRequest& request);
+    void parserIdle(CppParser* parser); // the parser stopped parsing or was unfrozen
+    int pendingCount();
+    qint64 queuedTime(CppParser* parser); // ms the parser's last started request waited
+private:
+    CppParserScheduler();
+    void runRequests(PCppParser parser);
+    void startRequests(PCppParser parser, int priority);
 private:
-    PCppParser mParser;
-    bool mUpdateView;
-    // QThread interface
-protected:
-    void run() override;
+    QMutex mMutex;
+    QHash<CppParser*,QList<CppParseRequest>> mPendingRequests;
+    QSet<CppParser*> mRunningParsers;
+    QHash<CppParser*,PCppParser> mWaitingParsers; // parsers busy with a parse not started by us
+    QHash<CppParser*,qint64> mQueuedTimes;
+    QThreadPool mPool;
 };
 
 void parseFile(
@@ -6,7 +6,9 @@
 #include <QDebug>
 #include <QMessageBox>
 
-CppPreprocessor::CppPreprocessor()
+CppPreprocessor::CppPreprocessor():
+    mLookups(nullptr),
+    mExpandDepthReached(false)
 {
 }
 
@@ -20,6 +22,8 @@ void CppPreprocessor::clear()
     mBranchResults.clear();
     mResult.clear();
     mCurrentIncludes.reset();
+    mMacroExpansions.clear();
+    mConditionExpansions.clear();
 }
 
 void CppPreprocessor::addDefineByParts(const QString &name, const QString &args, const QString &value, bool hardCoded)
@@ -107,7 +111,10 @@ void CppPreprocessor::addDefineByLine(const QString &line, bool hardCoded)
 
 PDefine CppPreprocessor::getDefine(const QString &name)
 {
-    return mDefines.value(name,PDefine());
+    PDefine define = mDefines.value(name,PDefine());
+    if (mLookups)
+        mLookups->append(DefineLookup(name,define));
+    return define;
 }
 
 PDefine CppPreprocessor::getHardDefine(const QString &name)
@@ -441,8 +448,10 @@ void CppPreprocessor::handleUndefine(const QString &line)
 QString CppPreprocessor::expandMacros(const QString &line, int depth)
 {
     //prevent infinit recursion
-    if (depth > MAX_DEFINE_EXPAND_DEPTH)
+    if (depth > MAX_DEFINE_EXPAND_DEPTH) {
+        mExpandDepthReached = true;
         return line;
+    }
     QString word;
     QString newLine;
     int lenLine = line.length();
@@ -498,7 +507,7 @@ void CppPreprocessor::expandMacro(const QString &line, QString &newLine, QString
         if (define && define->args=="" ) {
             //newLine:=newLine+RemoveGCCAttributes(define^.Value);
             if (define->value != word )
-              newLine += expandMacros(define->value,depth+1);
+              newLine += expandDefineValue(define,depth);
             else
               newLine += word;
 
@@ -536,6 +545,49 @@ void CppPreprocessor::expandMacro(const QString &line, QString &newLine, QString
     }
 }
 
+QString CppPreprocessor::expandDefineValue(const PDefine &define, int depth)
+{
+    // The same macros are used again and again in headers and all files including them
+    QString result;
+    if (findExpansion(mMacroExpansions,define->name,result))
+        return result;
+    QList<DefineLookup> lookups;
+    lookups.append(DefineLookup(define->name,define));
+    QList<DefineLookup>* oldLookups = mLookups;
+    bool oldDepthReached = mExpandDepthReached;
+    mLookups = &lookups;
+    mExpandDepthReached = false;
+    result = expandMacros(define->value,depth+1);
+    mLookups = oldLookups;
+    // the result is cut short, don't reuse it
+    if (!mExpandDepthReached) {
+        PMacroExpansion expansion = std::make_shared<MacroExpansion>();
+        expansion->result = result;
+        expansion->lookups = lookups;
+        mMacroExpansions.insert(define->name,expansion);
+    }
+    mExpandDepthReached = mExpandDepthReached || oldDepthReached;
+    if (mLookups)
+        mLookups->append(lookups);
+    return result;
+}
+
+bool CppPreprocessor::findExpansion(const QHash<QString, PMacroExpansion> &cache, const QString &key, QString &result)
+{
+    PMacroExpansion expansion = cache.value(key);
+    if (!expansion)
+        return false;
+    foreach (const DefineLookup& lookup, expansion->lookups) {
+        if (mDefines.value(lookup.first) != lookup.second)
+            return false;
+    }
+    // the expansion being created depends on the same macros
+    if (mLookups)
+        mLookups->append(expansion->lookups);
+    result = expansion->result;
+    return true;
+}
+
 QString CppPreprocessor::removeGCCAttributes(const QString &line)
 {
     QString newLine = "";
@@ -1159,7 +1211,18 @@ QString CppPreprocessor::lineBreak()
 
 bool CppPreprocessor::evaluateIf(const QString &line)
 {
-    QString newLine = expandDefines(line); // replace FOO by numerical value of FOO
+    // Headers test the same conditions many times, e.g. "__cplusplus >= 201103L"
+    QString newLine;
+    if (!findExpansion(mConditionExpansions,line,newLine)) {
+        QList<DefineLookup> lookups;
+        mLookups = &lookups;
+        newLine = expandDefines(line); // replace FOO by numerical value of FOO
+        mLookups = nullptr;
+        PMacroExpansion expansion = std::make_shared<MacroExpansion>();
+        expansion->result = newLine;
+        expansion->lookups = lookups;
+        mConditionExpansions.insert(line,expansion);
+    }
     return  evaluateExpression(newLine);
 }
 
@@ -1777,6 +1840,11 @@ QSet<QString> &CppPreprocessor::scannedFiles()
     return mScannedFiles;
 }
 
+QHash<QString, PDefineMap> &CppPreprocessor::fileDefines()
+{
+    return mFileDefines;
+}
+
 QHash<QString, PFileIncludes> &CppPreprocessor::includesList()
 {
     return mIncludesList;
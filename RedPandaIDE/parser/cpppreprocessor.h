@@ -29,6 +29,15 @@ struct ParsedFile {
 };
 using PParsedFile = std::shared_ptr<ParsedFile>;
 
+using DefineLookup = QPair<QString,PDefine>;
+// A saved macro expansion (or expanded #if condition).
+// It's only valid while all macros looked up when creating it are unchanged.
+struct MacroExpansion {
+    QString result;
+    QList<DefineLookup> lookups;
+};
+using PMacroExpansion = std::shared_ptr<MacroExpansion>;
+
 class CppPreprocessor
 {
     enum class ContentType {
@@ -70,6 +79,8 @@ public:
 
     QSet<QString> &scannedFiles();
 
+    QHash<QString, PDefineMap> &fileDefines();
+
     const QSet<QString> &includePaths();
 
     const QSet<QString> &projectIncludePaths();
@@ -94,6 +105,8 @@ private:
     void handlePreprocessor(const QString& value);
     void handleUndefine(const QString& line);
     QString expandMacros(const QString& line, int depth);
+    QString expandDefineValue(const PDefine& define, int depth);
+    bool findExpansion(const QHash<QString,PMacroExpansion>& cache, const QString& key, QString& result);
     void expandMacro(const QString& line, QString& newLine, QString& word, int& i, int depth);
     QString removeGCCAttributes(const QString& line);
     void removeGCCAttribute(const QString&line, QString& newLine, int &i, const QString& word);
@@ -199,6 +212,11 @@ private:
     bool mParseLocal;
     QSet<QString> mScannedFiles;
     QSet<QString> mProcessed; // dictionary to save filename already processed
+
+    QHash<QString,PMacroExpansion> mMacroExpansions; // macro name -> expanded value
+    QHash<QString,PMacroExpansion> mConditionExpansions; // #if condition -> expanded condition
+    QList<DefineLookup>* mLookups; // records macros looked up, for the expansion being created
+    bool mExpandDepthReached;
 };
 
 #endif // CPPPREPROCESSOR_H
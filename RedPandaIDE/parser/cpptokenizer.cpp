@@ -11,6 +11,7 @@ CppTokenizer::CppTokenizer()
 void CppTokenizer::reset()
 {
     mTokenList.clear();
+    mTokenTexts.clear();
     mBuffer.clear();
     mBufferStr.clear();
 }
@@ -27,6 +28,8 @@ void CppTokenizer::tokenize(const QStringList &buffer)
         mBufferStr+='\n';
         mBufferStr+=mBuffer[i];
     }
+    // a rough guess of the token count, to avoid reallocations
+    mTokenList.reserve(mBufferStr.length()/8);
     mStart = mBufferStr.data();
     mCurrent = mStart;
     mLineCount = mStart;
@@ -42,6 +45,7 @@ void CppTokenizer::tokenize(const QStringList &buffer)
         else
             addToken(s,mCurrentLine);
     }
+    mTokenTexts.clear();
 }
 
 void CppTokenizer::dumpTokens(const QString &fileName)
@@ -50,8 +54,8 @@ void CppTokenizer::dumpTokens(const QString &fileName)
 
     if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         QTextStream stream(&file);
-        foreach (const PToken& token,mTokenList) {
-            stream<<QString("%1,%2").arg(token->line).arg(token->text)<<Qt::endl;
+        foreach (const Token& token,mTokenList) {
+            stream<<QString("%1,%2").arg(token.line).arg(token.text)<<Qt::endl;
         }
     }
 }
@@ -61,9 +65,15 @@ const CppTokenizer::TokenList &CppTokenizer::tokens()
     return mTokenList;
 }
 
-CppTokenizer::PToken CppTokenizer::operator[](int i)
+void CppTokenizer::setTokens(const TokenList &tokens)
 {
-    return mTokenList[i];
+    reset();
+    mTokenList = tokens;
+}
+
+const CppTokenizer::Token* CppTokenizer::operator[](int i) const
+{
+    return &mTokenList.at(i);
 }
 
 int CppTokenizer::tokenCount()
@@ -73,9 +83,15 @@ int CppTokenizer::tokenCount()
 
 void CppTokenizer::addToken(const QString &sText, int iLine)
 {
-    PToken token = std::make_shared<Token>();
-    token->text = sText;
-    token->line = iLine;
+    Token token;
+    auto iter = mTokenTexts.constFind(sText);
+    if (iter!=mTokenTexts.constEnd()) {
+        token.text = *iter;
+    } else {
+        mTokenTexts.insert(sText);
+        token.text = sText;
+    }
+    token.line = iLine;
     mTokenList.append(token);
 }
 
@@ -581,7 +597,7 @@ void CppTokenizer::advance()
         break;
     case '=': {
         if (mTokenList.size()>2
-                && mTokenList[mTokenList.size()-2]->text == "using") {
+                && mTokenList[mTokenList.size()-2].text == "using") {
             addToken("=",mCurrentLine);
             mCurrent++;
         } else
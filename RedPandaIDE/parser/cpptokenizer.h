@@ -11,22 +11,21 @@ public:
       QString text;
       int line;
     };
-    using PToken = std::shared_ptr<Token>;
-    using TokenList = QVector<PToken>;
+    using TokenList = QVector<Token>; // tokens are stored contiguously
     explicit CppTokenizer();
 
     void reset();
     void tokenize(const QStringList& buffer);
     void dumpTokens(const QString& fileName);
     const TokenList& tokens();
-    PToken operator[](int i);
+    void setTokens(const TokenList& tokens);
+    const Token* operator[](int i) const;
     int tokenCount();
 signals:
 private:
     void addToken(const QString& sText, int iLine);
     void advance();
     void countLines();
-    PToken getToken(int index);
 
     QString getArguments();
     QString getForInit();
@@ -76,6 +75,7 @@ private:
     int mCurrentLine;
     QString mLastToken;
     TokenList mTokenList;
+    QSet<QString> mTokenTexts; // same token texts share one string
 };
 
 #endif // CPPTOKENIZER_H
@@ -468,6 +468,17 @@ void CppScopes::clear()
     mScopes.clear();
 }
 
+void CppScopes::truncate(int count)
+{
+    if (count<mScopes.count())
+        mScopes.resize(count);
+}
+
+const QVector<PCppScope> &CppScopes::scopes() const
+{
+    return mScopes;
+}
+
 MemberOperatorType getOperatorType(const QString &phrase, int index)
 {
     if (index>=phrase.length())
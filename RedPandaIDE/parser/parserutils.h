@@ -134,7 +134,6 @@ struct Statement {
     QSet<QString> usingList; // using namespaces
     int usageCount; //Usage Count, used by TCodeCompletion
     int freqTop; // Usage Count Rank, used by TCodeCompletion
-    bool caseMatch; // if match with case, used by TCodeCompletion
     QString noNameArgs;// Args without name
 };
 
@@ -167,6 +166,8 @@ public:
     PStatement lastScope();
     void removeLastScope();
     void clear();
+    void truncate(int count);
+    const QVector<PCppScope>& scopes() const;
 private:
     QVector<PCppScope> mScopes;
 };
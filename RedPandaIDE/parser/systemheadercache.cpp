@@ -0,0 +1,466 @@
+#include "systemheadercache.h"
+#include "../utils.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QQueue>
+#include <QSaveFile>
+
+// snapshots imported by the parsers, so other parsers for the same compiler set
+// can share them instead of loading/parsing the headers again
+static QMutex sharedSnapshotsMutex;
+static QHash<QString,std::weak_ptr<SystemHeaderSnapshot>> sharedSnapshots;
+
+static void writeDefine(QDataStream& out, const PDefine& define)
+{
+    out<<define->name
+      <<define->args
+      <<define->value
+      <<define->filename
+      <<define->argList
+      <<define->argUsed
+      <<define->formatValue;
+}
+
+static PDefine readDefine(QDataStream& in)
+{
+    PDefine define = std::make_shared<Define>();
+    in>>define->name
+      >>define->args
+      >>define->value
+      >>define->filename
+      >>define->argList
+      >>define->argUsed
+      >>define->formatValue;
+    define->hardCoded = false;
+    return define;
+}
+
+static void writeStatement(QDataStream& out, const PStatement& statement,
+                           const QHash<Statement*,int>& ids)
+{
+    PStatement parent = statement->parentScope.lock();
+    out<<(qint32)(parent?ids.value(parent.get(),-1):-1);
+    QList<qint32> inheritance;
+    foreach (const std::weak_ptr<Statement>& p, statement->inheritanceList) {
+        PStatement inheritStatement = p.lock();
+        if (inheritStatement && ids.contains(inheritStatement.get()))
+            inheritance.append(ids.value(inheritStatement.get()));
+    }
+    out<<inheritance;
+    out<<statement->hintText
+      <<statement->type
+      <<statement->command
+      <<statement->args
+      <<statement->argList
+      <<statement->value
+      <<(qint32)statement->kind
+      <<(qint32)statement->scope
+      <<(qint32)statement->classScope
+      <<statement->hasDefinition
+      <<(qint32)statement->line
+      <<(qint32)statement->endLine
+      <<(qint32)statement->definitionLine
+      <<(qint32)statement->definitionEndLine
+      <<statement->fileName
+      <<statement->definitionFileName
+      <<statement->inProject
+      <<statement->inSystemHeader
+      <<statement->friends
+      <<statement->isStatic
+      <<statement->isInherited
+      <<statement->fullName
+      <<statement->usingList
+      <<statement->noNameArgs;
+}
+
+// QDataStream creates a new QString for each string read, share the same ones
+static void internString(QString& s, QSet<QString>& pool)
+{
+    if (s.isEmpty())
+        return;
+    auto iter = pool.constFind(s);
+    if (iter!=pool.constEnd())
+        s = *iter;
+    else
+        pool.insert(s);
+}
+
+static PStatement readStatement(QDataStream& in, qint32& parentId, QList<qint32>& inheritance,
+                                QSet<QString>& pool)
+{
+    PStatement statement = std::make_shared<Statement>();
+    qint32 kind,scope,classScope,line,endLine,definitionLine,definitionEndLine;
+    in>>parentId;
+    in>>inheritance;
+    in>>statement->hintText
+      >>statement->type
+      >>statement->command
+      >>statement->args
+      >>statement->argList
+      >>statement->value
+      >>kind
+      >>scope
+      >>classScope
+      >>statement->hasDefinition
+      >>line
+      >>endLine
+      >>definitionLine
+      >>definitionEndLine
+      >>statement->fileName
+      >>statement->definitionFileName
+      >>statement->inProject
+      >>statement->inSystemHeader
+      >>statement->friends
+      >>statement->isStatic
+      >>statement->isInherited
+      >>statement->fullName
+      >>statement->usingList
+      >>statement->noNameArgs;
+    internString(statement->type,pool);
+    internString(statement->command,pool);
+    internString(statement->fileName,pool);
+    internString(statement->definitionFileName,pool);
+    statement->kind = (StatementKind)kind;
+    statement->scope = (StatementScope)scope;
+    statement->classScope = (StatementClassScope)classScope;
+    statement->line = line;
+    statement->endLine = endLine;
+    statement->definitionLine = definitionLine;
+    statement->definitionEndLine = definitionEndLine;
+    statement->usageCount = -1;
+    statement->freqTop = 0;
+    return statement;
+}
+
+// a broken cache can't have more items than the bytes left in it
+static bool isValidCount(QDataStream& in, qint32 count)
+{
+    return in.status()==QDataStream::Ok
+            && count>=0
+            && count<=in.device()->bytesAvailable();
+}
+
+static QList<qint32> statementIds(const StatementMap& statements,
+                                  const QHash<Statement*,int>& ids)
+{
+    QList<qint32> result;
+    foreach (const PStatement& statement, statements) {
+        if (statement && ids.contains(statement.get()))
+            result.append(ids.value(statement.get()));
+    }
+    return result;
+}
+
+static PStatement copyStatement(const PStatement& statement, const PStatement& parent,
+                                QHash<Statement*,PStatement>& copies)
+{
+    PStatement copy = std::make_shared<Statement>(*statement);
+    copy->parentScope = parent;
+    copy->inheritanceList.clear(); // set after all statements are copied
+    copies.insert(statement.get(),copy);
+    for (auto iter=copy->children.begin();iter!=copy->children.end();++iter) {
+        iter.value() = copyStatement(iter.value(),copy,copies);
+    }
+    return copy;
+}
+
+QString SystemHeaderCache::calculateKey(const QStringList &includePaths,
+                                        const DefineMap &hardDefines,
+                                        bool parseGlobalHeaders)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(SYSTEM_HEADER_CACHE_VERSION));
+    hash.addData(QByteArray(parseGlobalHeaders?"1":"0"));
+    foreach (const QString& path, includePaths) {
+        hash.addData(path.toUtf8());
+        hash.addData(QByteArray("\n"));
+    }
+    // hash iteration order is random, so sort the names first
+    QStringList names = hardDefines.keys();
+    names.sort();
+    foreach (const QString& name, names) {
+        const PDefine& define = hardDefines.value(name);
+        hash.addData(QString("%1 %2 %3\n").arg(define->name,define->args,define->value).toUtf8());
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString SystemHeaderCache::cacheFileName(const QString &cacheDir, const QString &key)
+{
+    return includeTrailingPathDelimiter(cacheDir)+key+"."+SYSTEM_HEADER_CACHE_EXT;
+}
+
+bool SystemHeaderCache::save(const QString &fileName, const PSystemHeaderSnapshot &snapshot)
+{
+    if (!snapshot)
+        return false;
+    QDir dir = QFileInfo(fileName).absoluteDir();
+    if (!dir.exists() && !dir.mkpath(dir.absolutePath()))
+        return false;
+
+    // Number the statements, parents are always numbered before their children
+    QHash<Statement*,int> ids;
+    StatementList statements;
+    QQueue<PStatement> queue;
+    foreach (const PStatement& statement, snapshot->statements) {
+        queue.enqueue(statement);
+    }
+    while (!queue.isEmpty()) {
+        PStatement statement = queue.dequeue();
+        if (ids.contains(statement.get()))
+            continue;
+        ids.insert(statement.get(),statements.count());
+        statements.append(statement);
+        foreach (const PStatement& child, statement->children) {
+            // don't save statements added by files outside of the cache (user's code)
+            if (snapshot->fileTimes.contains(child->fileName))
+                queue.enqueue(child);
+        }
+    }
+
+    // write to a temporary file first, so a crash never leaves a broken cache
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out<<(quint32)SYSTEM_HEADER_CACHE_MAGIC
+      <<(quint32)SYSTEM_HEADER_CACHE_VERSION
+      <<snapshot->key
+      <<(qint32)snapshot->uniqId;
+
+    out<<(qint32)snapshot->fileTimes.count();
+    for (auto iter=snapshot->fileTimes.cbegin();iter!=snapshot->fileTimes.cend();++iter) {
+        out<<iter.key()<<iter.value();
+    }
+
+    out<<(qint32)snapshot->fileDefines.count();
+    for (auto iter=snapshot->fileDefines.cbegin();iter!=snapshot->fileDefines.cend();++iter) {
+        out<<iter.key()<<(qint32)iter.value()->count();
+        foreach (const PDefine& define, *(iter.value())) {
+            writeDefine(out,define);
+        }
+    }
+
+    out<<(qint32)statements.count();
+    foreach (const PStatement& statement, statements) {
+        writeStatement(out,statement,ids);
+    }
+
+    out<<(qint32)snapshot->includes.count();
+    for (auto iter=snapshot->includes.cbegin();iter!=snapshot->includes.cend();++iter) {
+        const PFileIncludes& fileIncludes = iter.value();
+        out<<fileIncludes->baseFile
+          <<fileIncludes->includeFiles
+          <<fileIncludes->usings
+          <<statementIds(fileIncludes->statements,ids)
+          <<statementIds(fileIncludes->declaredStatements,ids);
+        const QVector<PCppScope>& scopes = fileIncludes->scopes.scopes();
+        out<<(qint32)scopes.count();
+        foreach (const PCppScope& scope, scopes) {
+            out<<(qint32)scope->startLine
+              <<(qint32)(scope->statement?ids.value(scope->statement.get(),-1):-1);
+        }
+        QSet<QString> dependingFiles;
+        foreach (const QString& s, fileIncludes->dependingFiles) {
+            if (snapshot->fileTimes.contains(s))
+                dependingFiles.insert(s);
+        }
+        QSet<QString> dependedFiles;
+        foreach (const QString& s, fileIncludes->dependedFiles) {
+            if (snapshot->fileTimes.contains(s))
+                dependedFiles.insert(s);
+        }
+        out<<dependingFiles
+          <<dependedFiles;
+    }
+
+    out<<snapshot->inlineNamespaces;
+    if (out.status()!=QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+PSystemHeaderSnapshot SystemHeaderCache::load(const QString &fileName, const QString &key)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return PSystemHeaderSnapshot();
+    qint64 size = file.size();
+    uchar* data = file.map(0,size);
+    QByteArray buffer;
+    if (data)
+        buffer = QByteArray::fromRawData((const char*)data,size);
+    else
+        buffer = file.readAll(); // can't map it, read it instead
+    auto action = finally([&file,data]{
+        if (data)
+            file.unmap(data);
+    });
+    QDataStream in(buffer);
+    in.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic,version;
+    QString cacheKey;
+    qint32 uniqId;
+    in>>magic>>version;
+    if (magic!=SYSTEM_HEADER_CACHE_MAGIC || version!=SYSTEM_HEADER_CACHE_VERSION)
+        return PSystemHeaderSnapshot();
+    in>>cacheKey>>uniqId;
+    if (cacheKey!=key)
+        return PSystemHeaderSnapshot();
+
+    PSystemHeaderSnapshot snapshot = std::make_shared<SystemHeaderSnapshot>();
+    snapshot->key = key;
+    snapshot->uniqId = uniqId;
+
+    qint32 count;
+    in>>count;
+    if (!isValidCount(in,count))
+        return PSystemHeaderSnapshot();
+    for (int i=0;i<count;i++) {
+        QString headerName;
+        qint64 time;
+        in>>headerName>>time;
+        if (in.status()!=QDataStream::Ok)
+            return PSystemHeaderSnapshot();
+        // the header is changed since the cache is created
+        if (QFileInfo(headerName).lastModified().toMSecsSinceEpoch()!=time)
+            return PSystemHeaderSnapshot();
+        snapshot->fileTimes.insert(headerName,time);
+    }
+
+    in>>count;
+    if (!isValidCount(in,count))
+        return PSystemHeaderSnapshot();
+    for (int i=0;i<count;i++) {
+        QString headerName;
+        qint32 defineCount;
+        in>>headerName>>defineCount;
+        if (!isValidCount(in,defineCount))
+            return PSystemHeaderSnapshot();
+        PDefineMap defineMap = std::make_shared<DefineMap>();
+        for (int j=0;j<defineCount;j++) {
+            PDefine define = readDefine(in);
+            if (in.status()!=QDataStream::Ok)
+                return PSystemHeaderSnapshot();
+            defineMap->insert(define->name,define);
+        }
+        snapshot->fileDefines.insert(headerName,defineMap);
+    }
+
+    in>>count;
+    if (!isValidCount(in,count))
+        return PSystemHeaderSnapshot();
+    QVector<PStatement> statements(count);
+    QVector<QList<qint32>> inheritances(count);
+    QSet<QString> pool;
+    for (int i=0;i<count;i++) {
+        qint32 parentId;
+        PStatement statement = readStatement(in,parentId,inheritances[i],pool);
+        if (in.status()!=QDataStream::Ok)
+            return PSystemHeaderSnapshot();
+        if (parentId>=0 && parentId<i) {
+            PStatement parent = statements[parentId];
+            statement->parentScope = parent;
+            parent->children.insert(statement->command,statement);
+        } else {
+            snapshot->statements.append(statement);
+        }
+        statements[i]=statement;
+    }
+    for (int i=0;i<count;i++) {
+        foreach (qint32 id, inheritances[i]) {
+            if (id>=0 && id<count)
+                statements[i]->inheritanceList.append(statements[id]);
+        }
+    }
+
+    in>>count;
+    if (!isValidCount(in,count))
+        return PSystemHeaderSnapshot();
+    for (int i=0;i<count;i++) {
+        PFileIncludes fileIncludes = std::make_shared<FileIncludes>();
+        QList<qint32> statementIdList;
+        QList<qint32> declaredIdList;
+        qint32 scopeCount;
+        in>>fileIncludes->baseFile
+          >>fileIncludes->includeFiles
+          >>fileIncludes->usings
+          >>statementIdList
+          >>declaredIdList
+          >>scopeCount;
+        if (!isValidCount(in,scopeCount))
+            return PSystemHeaderSnapshot();
+        foreach (qint32 id, statementIdList) {
+            if (id>=0 && id<statements.count())
+                fileIncludes->statements.insert(statements[id]->fullName,statements[id]);
+        }
+        foreach (qint32 id, declaredIdList) {
+            if (id>=0 && id<statements.count())
+                fileIncludes->declaredStatements.insert(statements[id]->fullName,statements[id]);
+        }
+        for (int j=0;j<scopeCount;j++) {
+            qint32 line,id;
+            in>>line>>id;
+            if (in.status()!=QDataStream::Ok)
+                return PSystemHeaderSnapshot();
+            if (id>=0 && id<statements.count())
+                fileIncludes->scopes.addScope(line,statements[id]);
+            else
+                fileIncludes->scopes.addScope(line,PStatement());
+        }
+        in>>fileIncludes->dependingFiles
+          >>fileIncludes->dependedFiles;
+        if (in.status()!=QDataStream::Ok)
+            return PSystemHeaderSnapshot();
+        snapshot->includes.insert(fileIncludes->baseFile,fileIncludes);
+    }
+
+    in>>snapshot->inlineNamespaces;
+    if (in.status()!=QDataStream::Ok)
+        return PSystemHeaderSnapshot();
+    return snapshot;
+}
+
+StatementList SystemHeaderCache::copyStatements(const StatementList &statements,
+                                                QHash<Statement *, PStatement> &copies)
+{
+    StatementList result;
+    foreach (const PStatement& statement, statements) {
+        result.append(copyStatement(statement,PStatement(),copies));
+    }
+    for (auto iter=copies.cbegin();iter!=copies.cend();++iter) {
+        foreach (const std::weak_ptr<Statement>& inheritance, iter.key()->inheritanceList) {
+            PStatement base = inheritance.lock();
+            if (!base)
+                continue;
+            PStatement copy = copies.value(base.get());
+            iter.value()->inheritanceList.append(copy?copy:base);
+        }
+    }
+    return result;
+}
+
+PSystemHeaderSnapshot SystemHeaderCache::shared(const QString &key)
+{
+    QMutexLocker locker(&sharedSnapshotsMutex);
+    PSystemHeaderSnapshot snapshot = sharedSnapshots.value(key).lock();
+    if (!snapshot)
+        sharedSnapshots.remove(key);
+    return snapshot;
+}
+
+void SystemHeaderCache::share(const PSystemHeaderSnapshot &snapshot)
+{
+    QMutexLocker locker(&sharedSnapshotsMutex);
+    sharedSnapshots.insert(snapshot->key,snapshot);
+}
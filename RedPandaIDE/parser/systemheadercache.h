@@ -0,0 +1,46 @@
+#ifndef SYSTEMHEADERCACHE_H
+#define SYSTEMHEADERCACHE_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include "parserutils.h"
+
+#define SYSTEM_HEADER_CACHE_MAGIC 0x52504843 // "RPHC"
+#define SYSTEM_HEADER_CACHE_VERSION 1
+#define SYSTEM_HEADER_CACHE_EXT "cache"
+
+// Parse results of the compiler set's headers, which can be saved to disk and
+// restored into a parser instead of reparsing the headers.
+// A shared snapshot is only read: its statements are used by all parsers that
+// imported it, and a parser copies them before it changes any of them.
+struct SystemHeaderSnapshot {
+    QString key; // calculated from include paths and hard defines
+    QHash<QString,qint64> fileTimes; // header -> last modified time (ms since epoch)
+    QHash<QString,PDefineMap> fileDefines; // defines created in each header
+    QHash<QString,PFileIncludes> includes; // include infos of each header
+    StatementList statements; // top level statements, others are reachable by Statement::children
+    QSet<QString> inlineNamespaces;
+    int uniqId; // last id used to name anonymous statements
+};
+using PSystemHeaderSnapshot = std::shared_ptr<SystemHeaderSnapshot>;
+
+class SystemHeaderCache
+{
+public:
+    static QString calculateKey(const QStringList& includePaths,
+                                const DefineMap& hardDefines,
+                                bool parseGlobalHeaders);
+    static QString cacheFileName(const QString& cacheDir, const QString& key);
+    static bool save(const QString& fileName, const PSystemHeaderSnapshot& snapshot);
+    // returns nullptr if the cache doesn't exist, is broken or is outdated
+    static PSystemHeaderSnapshot load(const QString& fileName, const QString& key);
+    // deep copy of the statement trees, copies maps the old statements to the new ones
+    static StatementList copyStatements(const StatementList& statements,
+                                        QHash<Statement*,PStatement>& copies);
+    // returns the snapshot in use by other parsers, or nullptr if there is none
+    static PSystemHeaderSnapshot shared(const QString& key);
+    static void share(const PSystemHeaderSnapshot& snapshot);
+};
+
+#endif // SYSTEMHEADERCACHE_H
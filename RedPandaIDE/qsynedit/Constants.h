@@ -12,6 +12,10 @@ extern const QChar SynSoftBreakGlyph;
 
 
 #define MAX_SCROLL 65535
+// lines whose ranges are scanned at once after the text is changed, the rest are scanned in idle time
+#define MAX_SYNC_RANGE_SCAN_LINES 2000
+// max milliseconds spent for each idle time range scan
+#define RANGE_SCAN_TIME_SLICE 15
 
 #define SYN_ATTR_COMMENT    0
 #define SYN_ATTR_IDENTIFIER 1
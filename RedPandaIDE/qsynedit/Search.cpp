@@ -2,7 +2,7 @@
 
 SynSearch::SynSearch(QObject *parent):SynSearchBase(parent)
 {
-
+    updateMatcher();
 }
 
 int SynSearch::length(int aIndex)
@@ -32,11 +32,7 @@ int SynSearch::findAll(const QString &text)
     int start=0;
     int next=-1;
     while (true) {
-        if (options().testFlag(ssoMatchCase)) {
-            next = text.indexOf(pattern(),start,Qt::CaseSensitive);
-        } else {
-            next = text.indexOf(pattern(),start,Qt::CaseInsensitive);
-        }
+        next = mMatcher.indexIn(text,start);
         if (next<0) {
             break;
         }
@@ -61,6 +57,29 @@ QString SynSearch::replace(const QString &, const QString &aReplacement)
     return aReplacement;
 }
 
+void SynSearch::setPattern(const QString &value)
+{
+    if (value == pattern())
+        return;
+    SynSearchBase::setPattern(value);
+    updateMatcher();
+}
+
+void SynSearch::setOptions(const SynSearchOptions &options)
+{
+    bool matchCaseChanged = (options.testFlag(ssoMatchCase) != this->options().testFlag(ssoMatchCase));
+    SynSearchBase::setOptions(options);
+    if (matchCaseChanged)
+        updateMatcher();
+}
+
+void SynSearch::updateMatcher()
+{
+    mMatcher.setPattern(pattern());
+    mMatcher.setCaseSensitivity(options().testFlag(ssoMatchCase)?
+                                    Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
 bool SynSearch::isDelimitChar(QChar ch)
 {
     return !(ch == '_' || ch.isLetterOrNumber());
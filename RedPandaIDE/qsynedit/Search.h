@@ -1,6 +1,7 @@
 #ifndef SYNSEARCH_H
 #define SYNSEARCH_H
 #include "SearchBase.h"
+#include <QStringMatcher>
 
 
 class SynSearch : public SynSearchBase
@@ -16,10 +17,14 @@ public:
     int resultCount() override;
     int findAll(const QString &text) override;
     QString replace(const QString &aOccurrence, const QString &aReplacement) override;
+    void setPattern(const QString &value) override;
+    void setOptions(const SynSearchOptions &options) override;
 private:
     bool isDelimitChar(QChar ch);
+    void updateMatcher();
 private:
     QList<int> mResults;
+    QStringMatcher mMatcher; // prepared once for the pattern, instead of for each line
 };
 
 #endif // SYNSEARCH_H
@@ -28,10 +28,10 @@ int SynSearchRegex::resultCount()
 
 int SynSearchRegex::findAll(const QString &text)
 {
-    if (pattern().isEmpty())
-        return 0;
     mResults.clear();
     mLengths.clear();
+    if (pattern().isEmpty())
+        return 0;
     QRegularExpressionMatchIterator it = mRegex.globalMatch(text);
     while (it.hasNext()) {
         QRegularExpressionMatch match = it.next();
@@ -49,6 +49,9 @@ QString SynSearchRegex::replace(const QString &aOccurrence, const QString &aRepl
 
 void SynSearchRegex::setPattern(const QString &value)
 {
+    // changing the pattern makes the regex be compiled again
+    if (value == pattern() && value == mRegex.pattern())
+        return;
     SynSearchBase::setPattern(value);
     mRegex.setPattern(value);
     updateRegexOptions();
@@ -62,13 +65,14 @@ void SynSearchRegex::setOptions(const SynSearchOptions &options)
 
 void SynSearchRegex::updateRegexOptions()
 {
+    QRegularExpression::PatternOptions patternOptions = mRegex.patternOptions();
     if (options().testFlag(SynSearchOption::ssoMatchCase)) {
-        mRegex.setPatternOptions(
-                    mRegex.patternOptions() &
-                    ~QRegularExpression::CaseInsensitiveOption);
+        patternOptions &= ~QRegularExpression::CaseInsensitiveOption;
     } else {
-        mRegex.setPatternOptions(
-                    mRegex.patternOptions() |
-                    QRegularExpression::CaseInsensitiveOption);
+        patternOptions |= QRegularExpression::CaseInsensitiveOption;
     }
+    if (patternOptions != mRegex.patternOptions())
+        mRegex.setPatternOptions(patternOptions);
+    // compile (and jit) the regex now, instead of at the first line searched
+    mRegex.optimize();
 }
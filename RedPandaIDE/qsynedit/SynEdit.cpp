@@ -7,6 +7,7 @@
 #include <QPaintEvent>
 #include <QPainter>
 #include <QTimerEvent>
+#include <QElapsedTimer>
 #include "highlighter/base.h"
 #include "Constants.h"
 #include "TextPainter.h"
@@ -29,6 +30,7 @@ SynEdit::SynEdit(QWidget *parent) : QAbstractScrollArea(parent)
     mPainting = false;
     mLines = std::make_shared<SynEditStringList>(this);
     mOrigLines = mLines;
+    std::fill(std::begin(mASCIICharColumns), std::end(mASCIICharColumns), -1);
     //fPlugins := TList.Create;
     mMouseMoved = false;
     mUndoing = false;
@@ -115,17 +117,26 @@ SynEdit::SynEdit(QWidget *parent) : QAbstractScrollArea(parent)
     mOptions = eoAutoIndent
             | eoDragDropEditing | eoEnhanceEndKey | eoTabIndent |
              eoGroupUndo | eoKeepCaretX | eoSelectWordByDblClick;
+    mUndoList->setMergeInserts(mOptions.testFlag(eoGroupUndo));
 
     mScrollTimer = new QTimer(this);
     mScrollTimer->setInterval(100);
     connect(mScrollTimer, &QTimer::timeout,this, &SynEdit::onScrollTimeout);
 
+    mRangeScanLine = -1;
+    mRangeScanCanStopLine = 0;
+    mRangeScanTimer = new QTimer(this);
+    mRangeScanTimer->setInterval(0);
+    connect(mRangeScanTimer, &QTimer::timeout,this, &SynEdit::onRangeScanTimeout);
+
     mScrollHintColor = QColorConstants::Yellow;
     mScrollHintFormat = SynScrollHintFormat::shfTopLineOnly;
 
     mContentImage = std::make_shared<QImage>(clientWidth(),clientHeight(),QImage::Format_ARGB32);
 
     mUseCodeFolding = true;
+    mCollapsedFoldsChanged = true;
+    mFoldsNeedRescan = true;
     m_blinkTimerId = 0;
     m_blinkStatus = 0;
 
@@ -870,31 +881,43 @@ int SynEdit::lineToRow(int aLine) const
 
 int SynEdit::foldRowToLine(int Row) const
 {
-    int result = Row;
-    for (int i=0;i<mAllFoldRanges.count();i++) {
-        PSynEditFoldRange range = mAllFoldRanges[i];
-        if (range->collapsed && !range->parentCollapsed() && range->fromLine < result) {
-            result += range->linesCollapsed;
-        }
+    updateCollapsedFolds();
+    // find the folds whose start row is before Row
+    int low = 0;
+    int high = mCollapsedFolds.count();
+    while (low<high) {
+        int mid = (low+high)/2;
+        if (mCollapsedFolds[mid]->fromLine - mCollapsedLinesBefore[mid] < Row)
+            low = mid+1;
+        else
+            high = mid;
     }
-    return result;
+    if (low == 0)
+        return Row;
+    return Row + mCollapsedLinesBefore[low-1] + mCollapsedFolds[low-1]->linesCollapsed;
 }
 
 int SynEdit::foldLineToRow(int Line) const
 {
-    int result = Line;
-    for (int i=mAllFoldRanges.count()-1;i>=0;i--) {
-        PSynEditFoldRange range =mAllFoldRanges[i];
-        if (range->collapsed && !range->parentCollapsed()) {
-            // Line is found after fold
-            if (range->toLine < Line)
-                result -= range->linesCollapsed;
-            // Inside fold
-            else if (range->fromLine < Line && Line <= range->toLine)
-                result -= Line - range->fromLine;
-        }
+    updateCollapsedFolds();
+    // find the last fold starting before Line
+    int low = 0;
+    int high = mCollapsedFolds.count();
+    while (low<high) {
+        int mid = (low+high)/2;
+        if (mCollapsedFolds[mid]->fromLine < Line)
+            low = mid+1;
+        else
+            high = mid;
     }
-    return result;
+    if (low == 0)
+        return Line;
+    PSynEditFoldRange range = mCollapsedFolds[low-1];
+    // Inside fold
+    if (Line <= range->toLine)
+        return range->fromLine - mCollapsedLinesBefore[low-1];
+    // Line is found after fold
+    return Line - mCollapsedLinesBefore[low-1] - range->linesCollapsed;
 }
 
 void SynEdit::setDefaultKeystrokes()
@@ -1192,8 +1215,8 @@ BufferCoord SynEdit::getPreviousLeftBrace(int x, int y)
 
 int SynEdit::charColumns(QChar ch) const
 {
-    if (ch == ' ')
-        return 1;
+    if (ch.unicode() < 128)
+        return mASCIICharColumns[ch.unicode()];
     //return std::ceil((int)(fontMetrics().horizontalAdvance(ch) * dpiFactor()) / (double)mCharWidth);
     return std::ceil((int)(fontMetrics().horizontalAdvance(ch)) / (double)mCharWidth);
 }
@@ -3032,6 +3055,22 @@ void SynEdit::recalcCharExtent()
     mTextHeight += mExtraLineSpacing;
     //mCharWidth = mCharWidth * dpiFactor();
     //mTextHeight = mTextHeight * dpiFactor();
+
+    // Measuring chars with the font metrics is slow, so keep the columns of
+    // the ascii chars. Line columns only need to be recalculated if they are changed.
+    bool asciiColumnsChanged = false;
+    QFontMetrics fm = fontMetrics();
+    for (int i=0;i<128;i++) {
+        int columns = 1;
+        if (i != ' ' && mCharWidth > 0)
+            columns = std::ceil(fm.horizontalAdvance(QChar(i)) / (double)mCharWidth);
+        if (mASCIICharColumns[i] != columns) {
+            mASCIICharColumns[i] = columns;
+            asciiColumnsChanged = true;
+        }
+    }
+    if (asciiColumnsChanged)
+        mLines->resetColumns();
 }
 
 QString SynEdit::expandAtWideGlyphs(const QString &S)
@@ -3073,25 +3112,43 @@ int SynEdit::scanFrom(int Index, int canStopIndex)
         mHighlighter->setState(mLines->ranges(Result-1));
     }
     do {
+        // lines after it are waiting for the idle time scan
+        if (mRangeScanLine>=0 && Result >= mRangeScanLine) {
+            scanRangesLater(mRangeScanLine, canStopIndex);
+            return Result;
+        }
+        // Don't block typing, scan the rest of a large file in idle time
+        if (Result-Index >= MAX_SYNC_RANGE_SCAN_LINES) {
+            scanRangesLater(Result, canStopIndex);
+            if (mUseCodeFolding && mFoldsNeedRescan)
+                rescanFolds();
+            return Result;
+        }
         mHighlighter->setLine(mLines->getString(Result), Result);
         mHighlighter->nextToEol();
         iRange = mHighlighter->getRangeState();
+        SynRangeState oldRange = mLines->ranges(Result);
         if (Result > canStopIndex){
-            if (mLines->ranges(Result).state == iRange.state
-                    && mLines->ranges(Result).braceLevel == iRange.braceLevel
-                    && mLines->ranges(Result).parenthesisLevel == iRange.parenthesisLevel
-                    && mLines->ranges(Result).bracketLevel == iRange.bracketLevel
+            if (oldRange.state == iRange.state
+                    && oldRange.braceLevel == iRange.braceLevel
+                    && oldRange.parenthesisLevel == iRange.parenthesisLevel
+                    && oldRange.bracketLevel == iRange.bracketLevel
                     ) {
-                if (mUseCodeFolding)
+                if (mUseCodeFolding && mFoldsNeedRescan)
                     rescanFolds();
                 return Result;// avoid the final Decrement
             }
         }
+        // Folds are built from the unpaired braces of each line, they can only
+        // be changed by lines whose unpaired braces are changed
+        if (oldRange.leftBraces != iRange.leftBraces
+                || oldRange.rightBraces != iRange.rightBraces)
+            mFoldsNeedRescan = true;
         mLines->setRange(Result,iRange);
         Result ++ ;
     } while (Result < mLines->count());
     Result--;
-    if (mUseCodeFolding)
+    if (mUseCodeFolding && mFoldsNeedRescan)
         rescanFolds();
     return Result;
 }
@@ -3119,19 +3176,110 @@ void SynEdit::rescanRange(int line)
 void SynEdit::rescanRanges()
 {
     if (mHighlighter && !mLines->empty()) {
-        mHighlighter->resetState();
-        for (int i =0;i<mLines->count();i++) {
-            mHighlighter->setLine(mLines->getString(i), i);
-            mHighlighter->nextToEol();
-            mLines->setRange(i, mHighlighter->getRangeState());
-        }
+        // scan the first part now, so the top of the file is painted correctly
+        mRangeScanLine = 0;
+        mRangeScanCanStopLine = INT_MAX;
+        onRangeScanTimeout();
+        return;
     }
     if (mUseCodeFolding)
         rescanFolds();
 }
 
+void SynEdit::scanRangesLater(int line, int canStopIndex)
+{
+    if (mRangeScanLine>=0) {
+        mRangeScanLine = std::min(mRangeScanLine,line);
+        mRangeScanCanStopLine = std::max(mRangeScanCanStopLine,canStopIndex);
+    } else {
+        mRangeScanLine = line;
+        mRangeScanCanStopLine = canStopIndex;
+    }
+    mRangeScanTimer->start();
+}
+
+void SynEdit::onRangeScanTimeout()
+{
+    if (mRangeScanLine<0 || !mHighlighter || mRangeScanLine>=mLines->count()) {
+        mRangeScanLine = -1;
+        mRangeScanTimer->stop();
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    int line = mRangeScanLine;
+    if (line == 0) {
+        mHighlighter->resetState();
+    } else {
+        mHighlighter->setState(mLines->ranges(line-1));
+    }
+    bool finished = false;
+    while (true) {
+        mHighlighter->setLine(mLines->getString(line), line);
+        mHighlighter->nextToEol();
+        SynRangeState iRange = mHighlighter->getRangeState();
+        SynRangeState oldRange = mLines->ranges(line);
+        if (line > mRangeScanCanStopLine) {
+            if (oldRange.state == iRange.state
+                    && oldRange.braceLevel == iRange.braceLevel
+                    && oldRange.parenthesisLevel == iRange.parenthesisLevel
+                    && oldRange.bracketLevel == iRange.bracketLevel) {
+                finished = true;
+                break;
+            }
+        }
+        if (oldRange.leftBraces != iRange.leftBraces
+                || oldRange.rightBraces != iRange.rightBraces)
+            mFoldsNeedRescan = true;
+        mLines->setRange(line,iRange);
+        line++;
+        if (line >= mLines->count()) {
+            finished = true;
+            break;
+        }
+        if (timer.elapsed() >= RANGE_SCAN_TIME_SLICE)
+            break;
+    }
+    int firstLine = mRangeScanLine;
+    if (finished) {
+        mRangeScanLine = -1;
+        mRangeScanTimer->stop();
+        if (mUseCodeFolding && mFoldsNeedRescan)
+            rescanFolds();
+        invalidate();
+    } else {
+        mRangeScanLine = line;
+        mRangeScanTimer->start();
+        invalidateLines(firstLine+1, INT_MAX);
+    }
+}
+
+void SynEdit::updateCollapsedFolds() const
+{
+    if (!mCollapsedFoldsChanged)
+        return;
+    mCollapsedFolds.clear();
+    mCollapsedLinesBefore.clear();
+    for (int i=0;i<mAllFoldRanges.count();i++) {
+        PSynEditFoldRange range = mAllFoldRanges[i];
+        if (range->collapsed && !range->parentCollapsed())
+            mCollapsedFolds.append(range);
+    }
+    std::sort(mCollapsedFolds.begin(),mCollapsedFolds.end(),
+              [](const PSynEditFoldRange& range1, const PSynEditFoldRange& range2) {
+        return range1->fromLine < range2->fromLine;
+    });
+    int linesBefore = 0;
+    foreach (const PSynEditFoldRange& range, mCollapsedFolds) {
+        mCollapsedLinesBefore.append(linesBefore);
+        linesBefore += range->linesCollapsed;
+    }
+    mCollapsedFoldsChanged = false;
+}
+
 void SynEdit::uncollapse(PSynEditFoldRange FoldRange)
 {
+    mCollapsedFoldsChanged = true;
     FoldRange->linesCollapsed = 0;
     FoldRange->collapsed = false;
 
@@ -3144,6 +3292,7 @@ void SynEdit::uncollapse(PSynEditFoldRange FoldRange)
 
 void SynEdit::collapse(PSynEditFoldRange FoldRange)
 {
+    mCollapsedFoldsChanged = true;
     FoldRange->linesCollapsed = FoldRange->toLine - FoldRange->fromLine;
     FoldRange->collapsed = true;
 
@@ -3162,6 +3311,7 @@ void SynEdit::collapse(PSynEditFoldRange FoldRange)
 
 void SynEdit::foldOnListInserted(int Line, int Count)
 {
+    mCollapsedFoldsChanged = true;
     // Delete collapsed inside selection
     for (int i = mAllFoldRanges.count()-1;i>=0;i--) {
         PSynEditFoldRange range = mAllFoldRanges[i];
@@ -3170,29 +3320,46 @@ void SynEdit::foldOnListInserted(int Line, int Count)
                 uncollapse(range);
             else if (range->fromLine >= Line) // insertion of count lines above FromLine
                 range->move(Count);
+        } else {
+            // braces in the new lines are checked by scanFrom()
+            if (range->fromLine >= Line)
+                range->move(Count);
+            else if (range->toLine >= Line)
+                range->toLine += Count;
         }
     }
 }
 
 void SynEdit::foldOnListDeleted(int Line, int Count)
 {
+    mCollapsedFoldsChanged = true;
     // Delete collapsed inside selection
     for (int i = mAllFoldRanges.count()-1;i>=0;i--) {
         PSynEditFoldRange range = mAllFoldRanges[i];
         if (range->collapsed || range->parentCollapsed()){
             if (range->fromLine == Line && Count == 1)  // open up because we are messing with the starting line
                 uncollapse(range);
-            else if (range->fromLine >= Line - 1 && range->fromLine < Line + Count) // delete inside affectec area
+            else if (range->fromLine >= Line - 1 && range->fromLine < Line + Count) { // delete inside affectec area
                 mAllFoldRanges.remove(i);
+                mFoldsNeedRescan = true;
+            }
             else if (range->fromLine >= Line + Count) // Move after affected area
                 range->move(-Count);
+        } else if ((range->fromLine >= Line && range->fromLine < Line + Count)
+                   || (range->toLine >= Line && range->toLine < Line + Count)) {
+            // the braces starting or ending this fold are deleted
+            mFoldsNeedRescan = true;
+        } else if (range->fromLine >= Line + Count) {
+            range->move(-Count);
+        } else if (range->toLine >= Line + Count) {
+            range->toLine -= Count;
         }
     }
-
 }
 
 void SynEdit::foldOnListCleared()
 {
+    mCollapsedFoldsChanged = true;
     mAllFoldRanges.clear();
 }
 
@@ -3208,6 +3375,8 @@ static void null_deleter(SynEditFoldRanges *) {}
 
 void SynEdit::rescanForFoldRanges()
 {
+    mCollapsedFoldsChanged = true;
+    mFoldsNeedRescan = false;
     // Delete all uncollapsed folds
     for (int i=mAllFoldRanges.count()-1;i>=0;i--) {
         PSynEditFoldRange range =mAllFoldRanges[i];
@@ -3583,6 +3752,8 @@ void SynEdit::onSizeOrFontChanged(bool bFont)
         mLinesInWindow = clientHeight() / mTextHeight;
         bool scrollBarChangedSettings = mStateFlags.testFlag(SynStateFlag::sfScrollbarChanged);
         if (bFont) {
+            // token columns depend on the font
+            mLineTokens.clear();
             if (mGutter.showLineNumbers())
                 onGutterChanged();
             else
@@ -3792,6 +3963,7 @@ void SynEdit::setTabWidth(int tabWidth)
     if (tabWidth!=mTabWidth) {
         mTabWidth = tabWidth;
         mLines->resetColumns();
+        mLineTokens.clear();
         invalidate();
     }
 }
@@ -3816,6 +3988,7 @@ void SynEdit::setOptions(const SynEditorOptions &Value)
         //bool bUpdateScroll = (Options * ScrollOptions)<>(Value * ScrollOptions);
         bool bUpdateScroll = true;
         mOptions = Value;
+        mUndoList->setMergeInserts(mOptions.testFlag(eoGroupUndo));
 
         // constrain caret position to MaxScrollWidth if eoScrollPastEol is enabled
         internalSetCaretXY(caretXY());
@@ -4415,6 +4588,8 @@ void SynEdit::setUseCodeFolding(bool value)
 {
     if (mUseCodeFolding!=value) {
         mUseCodeFolding = value;
+        // folds are not maintained while code folding is off
+        mFoldsNeedRescan = true;
     }
 }
 
@@ -4446,6 +4621,7 @@ void SynEdit::setHighlighter(const PSynHighlighter &highlighter)
 {
     PSynHighlighter oldHighlighter= mHighlighter;
     mHighlighter = highlighter;
+    mLineTokens.clear();
     if (oldHighlighter && mHighlighter &&
             oldHighlighter->language() == highlighter->language()) {
     } else {
@@ -4731,6 +4907,7 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
     {
         auto action = finally([&,this]{
             if (dobatchReplace) {
+                ensureCursorPosVisibleEx(true);
                 decPaintLock();
                 mUndoList->EndBlock();
             }
@@ -4780,8 +4957,11 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
                 setBlockBegin(ptCurrent);
 
                 //Be sure to use the Ex version of CursorPos so that it appears in the middle if necessary
-                setCaretXYEx(false, BufferCoord{1, ptCurrent.Line});
-                ensureCursorPosVisibleEx(true);
+                //It's useless to scroll to each occurrence when replacing all of them
+                if (!dobatchReplace) {
+                    setCaretXYEx(false, BufferCoord{1, ptCurrent.Line});
+                    ensureCursorPosVisibleEx(true);
+                }
                 ptCurrent.Char += nSearchLen;
                 setBlockEnd(ptCurrent);
                 //internalSetCaretXY(ptCurrent);
@@ -6066,6 +6246,9 @@ void SynEdit::onLinesChanging()
 
 void SynEdit::onLinesCleared()
 {
+    mLineTokens.clear();
+    mRangeScanLine = -1;
+    mRangeScanTimer->stop();
     if (mUseCodeFolding)
         foldOnListCleared();
     clearUndo();
@@ -6082,6 +6265,12 @@ void SynEdit::onLinesCleared()
 
 void SynEdit::onLinesDeleted(int index, int count)
 {
+    if (index < mLineTokens.count())
+        mLineTokens.remove(index, std::min(count, mLineTokens.count()-index));
+    if (mRangeScanLine>index) {
+        mRangeScanLine = std::max(index, mRangeScanLine - count);
+        mRangeScanCanStopLine = std::max(index, mRangeScanCanStopLine - count);
+    }
     if (mUseCodeFolding)
         foldOnListDeleted(index + 1, count);
     if (mHighlighter && mLines->count() > 0)
@@ -6092,6 +6281,13 @@ void SynEdit::onLinesDeleted(int index, int count)
 
 void SynEdit::onLinesInserted(int index, int count)
 {
+    if (index < mLineTokens.count())
+        mLineTokens.insert(index, count, PSynLineTokens());
+    if (mRangeScanLine>index) {
+        mRangeScanLine += count;
+        if (mRangeScanCanStopLine!=INT_MAX)
+            mRangeScanCanStopLine += count;
+    }
     if (mUseCodeFolding)
         foldOnListInserted(index + 1, count);
     if (mHighlighter && mLines->count() > 0) {
@@ -6107,6 +6303,8 @@ void SynEdit::onLinesInserted(int index, int count)
 
 void SynEdit::onLinesPutted(int index, int count)
 {
+    for (int i=index;i<std::min(index+count,mLineTokens.count());i++)
+        mLineTokens[i] = PSynLineTokens();
     int vEndLine = index + 1;
     if (mHighlighter) {
         vEndLine = std::max(vEndLine, scanFrom(index, index+count) + 1);
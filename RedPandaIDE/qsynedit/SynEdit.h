@@ -14,6 +14,7 @@
 #include "TextBuffer.h"
 #include "KeyStrokes.h"
 #include "SearchBase.h"
+#include "TextPainter.h"
 
 enum class SynFontSmoothMethod {
     None, AntiAlias, ClearType
@@ -464,6 +465,8 @@ private:
     int scanFrom(int Index, int canStopIndex);
     void rescanRange(int line);
     void rescanRanges();
+    void scanRangesLater(int line, int canStopIndex);
+    void updateCollapsedFolds() const;
     void uncollapse(PSynEditFoldRange FoldRange);
     void collapse(PSynEditFoldRange FoldRange);
 
@@ -572,6 +575,7 @@ private slots:
     void onLinesPutted(int index, int count);
     void onRedoAdded();
     void onScrollTimeout();
+    void onRangeScanTimeout();
     void onUndoAdded();
     void onSizeOrFontChanged(bool bFont);
     void onChanged();
@@ -580,6 +584,12 @@ private slots:
 private:
     std::shared_ptr<QImage> mContentImage;
     SynEditFoldRanges mAllFoldRanges;
+    // outermost collapsed folds sorted by fromLine, for mapping between rows and lines
+    mutable QVector<PSynEditFoldRange> mCollapsedFolds;
+    mutable QVector<int> mCollapsedLinesBefore; // lines hidden by the folds before each one
+    mutable bool mCollapsedFoldsChanged;
+    bool mFoldsNeedRescan; // brace structure changed since the last rescanForFoldRanges()
+    QVector<PSynLineTokens> mLineTokens; // tokens of painted lines, indexed by line
     SynEditCodeFolding mCodeFolding;
     bool mUseCodeFolding;
     bool  mAlwaysShowCaret;
@@ -613,6 +623,7 @@ private:
     SynScrollHintFormat mScrollHintFormat;
     SynScrollStyle mScrollBars;
     int mTextHeight;
+    int mASCIICharColumns[128]; // columns of ascii chars in the current font
     int mTopLine;
     PSynHighlighter mHighlighter;
     QColor mSelectedForeground;
@@ -662,6 +673,9 @@ private:
     QTimer*  mScrollTimer;
     int mScrollDeltaX;
     int mScrollDeltaY;
+    QTimer* mRangeScanTimer;
+    int mRangeScanLine; // ranges from this line are not scanned yet, -1 if all ranges are scanned
+    int mRangeScanCanStopLine; // idle time scan can stop after this line if a range is unchanged
 
     PSynEdit  fChainedEditor;
 
@@ -5,6 +5,8 @@
 #include <QTextStream>
 #include <QMutexLocker>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 #include "SynEdit.h"
 #include "../utils.h"
 #include "../platform.h"
@@ -16,7 +18,6 @@ SynEditStringList::SynEditStringList(SynEdit *pEdit, QObject *parent):
 {
     mAppendNewLineAtEOF = true;
     mFileEndingType = FileEndingType::Windows;
-    mIndexOfLongestLine = -1;
     mUpdateCount = 0;
 }
 
@@ -24,13 +25,32 @@ static void ListIndexOutOfBounds(int index) {
     throw IndexOutOfRange(index);
 }
 
+static PSynRangeState emptyRangeState() {
+    static PSynRangeState state = std::make_shared<SynRangeState>(SynRangeState{0,0,0,0,0});
+    return state;
+}
+
+// SynRangeState::operator== only compares the fields needed by the highlighter
+static bool isSameRange(const SynRangeState& range1, const SynRangeState& range2) {
+    return range1.state == range2.state
+            && range1.spaceState == range2.spaceState
+            && range1.braceLevel == range2.braceLevel
+            && range1.bracketLevel == range2.bracketLevel
+            && range1.parenthesisLevel == range2.parenthesisLevel
+            && range1.leftBraces == range2.leftBraces
+            && range1.rightBraces == range2.rightBraces
+            && range1.firstIndentThisLine == range2.firstIndentThisLine
+            && range1.indents == range2.indents
+            && range1.matchingIndents == range2.matchingIndents;
+}
+
 
 
 int SynEditStringList::parenthesisLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.parenthesisLevel;
+        return mList[Index]->fRange->parenthesisLevel;
     } else
         return 0;
 }
@@ -39,7 +59,7 @@ int SynEditStringList::bracketLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.bracketLevel;
+        return mList[Index]->fRange->bracketLevel;
     } else
         return 0;
 }
@@ -48,7 +68,7 @@ int SynEditStringList::braceLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.braceLevel;
+        return mList[Index]->fRange->braceLevel;
     } else
         return 0;
 }
@@ -69,7 +89,7 @@ int SynEditStringList::lineColumns(int Index)
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
         if (mList[Index]->fColumns == -1) {
-            return calculateLineColumns(Index);
+            return calculateLineColumns(mList[Index].get());
         } else
             return mList[Index]->fColumns;
     } else
@@ -80,7 +100,7 @@ int SynEditStringList::leftBraces(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.leftBraces;
+        return mList[Index]->fRange->leftBraces;
     } else
         return 0;
 }
@@ -89,30 +109,23 @@ int SynEditStringList::rightBraces(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.rightBraces;
+        return mList[Index]->fRange->rightBraces;
     } else
         return 0;
 }
 
 int SynEditStringList::lengthOfLongestLine() {
     QMutexLocker locker(&mMutex);
-    if (mIndexOfLongestLine < 0) {
-        int MaxLen = -1;
-        mIndexOfLongestLine = -1;
-        if (mList.count() > 0 ) {
-            for (int i=0;i<mList.size();i++) {
-                int len = lineColumns(i);
-                if (len > MaxLen) {
-                    MaxLen = len;
-                    mIndexOfLongestLine = i;
-                }
-            }
-        }
+    // only the lines changed since the last call need to be measured
+    QSet<SynEditStringRec*> lines;
+    lines.swap(mUncountedLines);
+    foreach (SynEditStringRec* line, lines) {
+        if (line->fColumns == -1)
+            calculateLineColumns(line);
     }
-    if (mIndexOfLongestLine >= 0)
-        return mList[mIndexOfLongestLine]->fColumns;
-    else
+    if (mLineColumnsCount.isEmpty())
         return 0;
+    return mLineColumnsCount.lastKey();
 }
 
 QString SynEditStringList::lineBreak() const
@@ -132,7 +145,7 @@ SynRangeState SynEditStringList::ranges(int Index)
 {
     QMutexLocker locker(&mMutex);
     if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange;
+        return *(mList[Index]->fRange);
     } else {
          ListIndexOutOfBounds(Index);
     }
@@ -144,7 +157,7 @@ void SynEditStringList::insertItem(int Index, const QString &s)
     beginUpdate();
     PSynEditStringRec line = std::make_shared<SynEditStringRec>();
     line->fString = s;
-    mIndexOfLongestLine = -1;
+    lineAdded(line.get());
     mList.insert(Index,line);
     endUpdate();
 }
@@ -154,7 +167,7 @@ void SynEditStringList::addItem(const QString &s)
     beginUpdate();
     PSynEditStringRec line = std::make_shared<SynEditStringRec>();
     line->fString = s;
-    mIndexOfLongestLine = -1;
+    lineAdded(line.get());
     mList.append(line);
     endUpdate();
 }
@@ -178,7 +191,7 @@ void SynEditStringList::setRange(int Index, const SynRangeState& ARange)
         ListIndexOutOfBounds(Index);
     }
     beginUpdate();
-    mList[Index]->fRange = ARange;
+    mList[Index]->fRange = shareRange(Index,ARange);
     endUpdate();
 }
 
@@ -227,7 +240,6 @@ void SynEditStringList::setContents(const QStringList &text)
     });
     internalClear();
     if (text.count() > 0) {
-        mIndexOfLongestLine = -1;
         int FirstAdded = mList.count();
 
         foreach (const QString& s,text) {
@@ -280,7 +292,6 @@ void SynEditStringList::addStrings(const QStringList &Strings)
 {
     QMutexLocker locker(&mMutex);
     if (Strings.count() > 0) {
-        mIndexOfLongestLine = -1;
         beginUpdate();
         auto action = finally([this]{
             endUpdate();
@@ -327,13 +338,12 @@ void SynEditStringList::deleteLines(int Index, int NumLines)
     auto action = finally([this]{
         endUpdate();
     });
-    if (mIndexOfLongestLine>=Index && (mIndexOfLongestLine <Index+NumLines)) {
-        mIndexOfLongestLine = - 1;
-    }
     int LinesAfter = mList.count() - (Index + NumLines);
     if (LinesAfter < 0) {
        NumLines = mList.count() - Index;
     }
+    for (int i=Index;i<Index+NumLines;i++)
+        lineRemoved(mList[i].get());
     mList.remove(Index,NumLines);
     emit deleted(Index,NumLines);
 }
@@ -349,11 +359,6 @@ void SynEditStringList::exchange(int Index1, int Index2)
     }
     beginUpdate();
     mList.swapItemsAt(Index1,Index2);
-    if (mIndexOfLongestLine == Index1) {
-        mIndexOfLongestLine = Index2;
-    } else if (mIndexOfLongestLine == Index2) {
-        mIndexOfLongestLine = Index1;
-    }
     endUpdate();
 }
 
@@ -376,8 +381,7 @@ void SynEditStringList::deleteAt(int Index)
         ListIndexOutOfBounds(Index);
     }
     beginUpdate();
-    if (mIndexOfLongestLine == Index)
-        mIndexOfLongestLine = -1;
+    lineRemoved(mList[Index].get());
     mList.removeAt(Index);
     emit deleted(Index,1);
     endUpdate();
@@ -406,9 +410,8 @@ void SynEditStringList::putString(int Index, const QString &s) {
             ListIndexOutOfBounds(Index);
         }
         beginUpdate();
-        mIndexOfLongestLine = -1;
         mList[Index]->fString = s;
-        mList[Index]->fColumns = -1;
+        uncountLineColumns(mList[Index].get());
         emit putted(Index,1);
         endUpdate();
     }
@@ -433,14 +436,51 @@ void SynEditStringList::setUpdateState(bool Updating)
         emit changed();
 }
 
-int SynEditStringList::calculateLineColumns(int Index)
+PSynRangeState SynEditStringList::shareRange(int Index, const SynRangeState &range)
 {
-    PSynEditStringRec line = mList[Index];
+    // Most lines have the same state as the lines around them
+    if (isSameRange(*(mList[Index]->fRange),range))
+        return mList[Index]->fRange;
+    if (Index>0 && isSameRange(*(mList[Index-1]->fRange),range))
+        return mList[Index-1]->fRange;
+    if (Index+1<mList.count() && isSameRange(*(mList[Index+1]->fRange),range))
+        return mList[Index+1]->fRange;
+    return std::make_shared<SynRangeState>(range);
+}
 
+int SynEditStringList::calculateLineColumns(SynEditStringRec* line)
+{
     line->fColumns = mEdit->stringColumns(line->fString,0);
+    mLineColumnsCount[line->fColumns]++;
+    mUncountedLines.remove(line);
     return line->fColumns;
 }
 
+void SynEditStringList::uncountLineColumns(SynEditStringRec *line)
+{
+    if (line->fColumns != -1) {
+        QMap<int,int>::iterator it = mLineColumnsCount.find(line->fColumns);
+        if (it != mLineColumnsCount.end()) {
+            it.value()--;
+            if (it.value() <= 0)
+                mLineColumnsCount.erase(it);
+        }
+        line->fColumns = -1;
+    }
+    mUncountedLines.insert(line);
+}
+
+void SynEditStringList::lineAdded(SynEditStringRec *line)
+{
+    mUncountedLines.insert(line);
+}
+
+void SynEditStringList::lineRemoved(SynEditStringRec *line)
+{
+    uncountLineColumns(line);
+    mUncountedLines.remove(line);
+}
+
 void SynEditStringList::insertLines(int Index, int NumLines)
 {
     QMutexLocker locker(&mMutex);
@@ -457,6 +497,7 @@ void SynEditStringList::insertLines(int Index, int NumLines)
     mList.insert(Index,NumLines,line);
     for (int i=Index;i<Index+NumLines;i++) {
         line = std::make_shared<SynEditStringRec>();
+        lineAdded(line.get());
         mList[i]=line;
     }
     emit inserted(Index,NumLines);
@@ -479,6 +520,7 @@ void SynEditStringList::insertStrings(int Index, const QStringList &NewStrings)
     for (int i=0;i<NewStrings.length();i++) {
         line = std::make_shared<SynEditStringRec>();
         line->fString = NewStrings[i];
+        lineAdded(line.get());
         mList[i+Index]=line;
     }
     emit inserted(Index,NewStrings.length());
@@ -512,46 +554,77 @@ void SynEditStringList::loadFromFile(const QString& filename, const QByteArray&
             realEncoding = ENCODING_ASCII;
             return;
         }
-        QByteArray line = file.readLine();
+        // Map the file and split lines in place, instead of reading and
+        // allocating a buffer for each line
+        qint64 size = file.size();
+        uchar* mapped = file.map(0,size);
+        QByteArray content;
+        if (mapped)
+            content = QByteArray::fromRawData((const char*)mapped,size);
+        else
+            content = file.readAll(); // can't map it, read it instead
+        auto unmapAction = finally([&file,mapped]{
+            if (mapped)
+                file.unmap(mapped);
+        });
+        const char* p = content.constData();
+        const char* end = p + content.size();
         QTextCodec* codec;
         QTextCodec::ConverterState state;
         bool needReread = false;
         bool allAscii = true;
         //test for BOM
-        if ((line.length()>=3) && ((unsigned char)line[0]==0xEF) && ((unsigned char)line[1]==0xBB) && ((unsigned char)line[2]==0xBF) ) {
+        if ((end-p>=3) && ((unsigned char)p[0]==0xEF) && ((unsigned char)p[1]==0xBB) && ((unsigned char)p[2]==0xBF) ) {
             realEncoding = ENCODING_UTF8_BOM;
-            line = line.mid(3);
+            p+=3;
             codec = QTextCodec::codecForName(ENCODING_UTF8);
         } else {
             realEncoding = ENCODING_UTF8;
             codec = QTextCodec::codecForName(ENCODING_UTF8);
         }
-        if (line.endsWith("\r\n")) {
-            mFileEndingType = FileEndingType::Windows;
-        } else if (line.endsWith("\n")) {
-            mFileEndingType = FileEndingType::Linux;
-        } else if (line.endsWith("\r")) {
+        const char* firstLineEnd = (const char*)memchr(p,'\n',end-p);
+        if (firstLineEnd) {
+            if (firstLineEnd>p && *(firstLineEnd-1)=='\r')
+                mFileEndingType = FileEndingType::Windows;
+            else
+                mFileEndingType = FileEndingType::Linux;
+        } else if (end>p && *(end-1)=='\r') {
             mFileEndingType = FileEndingType::Mac;
         }
         internalClear();
-        while (true) {
+        mList.reserve(std::count(p,end,'\n')+1);
+        while (p<end) {
+            const char* lineEnd = (const char*)memchr(p,'\n',end-p);
+            const char* next;
+            if (lineEnd) {
+                next = lineEnd+1;
+            } else {
+                lineEnd = end;
+                next = end;
+            }
+            // trim right, like TrimRight()
+            int len = lineEnd - p;
+            while (len>0 && (unsigned char)p[len-1]<=32)
+                len--;
             if (allAscii) {
-                allAscii = isTextAllAscii(line);
+                for (int i=0;i<len;i++) {
+                    if ((unsigned char)p[i]>127) {
+                        allAscii = false;
+                        break;
+                    }
+                }
             }
             if (allAscii) {
-                addItem(TrimRight(QString::fromLatin1(line)));
+                addItem(QString::fromLatin1(p,len));
             } else {
-                QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
+                QString newLine = codec->toUnicode(p,len,&state);
                 if (state.invalidChars>0) {
                     needReread = true;
                     break;
                 }
-                addItem(TrimRight(newLine));
+                addItem(newLine);
             }
-            if (file.atEnd()){
-                break;
-            }
-            line = file.readLine();
+            p = next;
         }
         emit inserted(0,mList.count());
         if (!needReread) {
@@ -666,7 +739,8 @@ void SynEditStringList::internalClear()
     if (!mList.isEmpty()) {
         beginUpdate();
         int oldCount = mList.count();
-        mIndexOfLongestLine = -1;
+        mLineColumnsCount.clear();
+        mUncountedLines.clear();
         mList.clear();
         emit deleted(0,oldCount);
         endUpdate();
@@ -694,27 +768,24 @@ bool SynEditStringList::empty()
 void SynEditStringList::resetColumns()
 {
     QMutexLocker locker(&mMutex);
-    mIndexOfLongestLine = -1;
-    if (mList.count() > 0 ) {
-        for (int i=0;i<mList.size();i++) {
-            mList[i]->fColumns = -1;
-        }
+    mLineColumnsCount.clear();
+    mUncountedLines.clear();
+    mUncountedLines.reserve(mList.count());
+    for (int i=0;i<mList.size();i++) {
+        mList[i]->fColumns = -1;
+        mUncountedLines.insert(mList[i].get());
     }
 }
 
 void SynEditStringList::invalidAllLineColumns()
 {
-    QMutexLocker locker(&mMutex);
-    mIndexOfLongestLine = -1;
-    for (PSynEditStringRec& line:mList) {
-        line->fColumns = -1;
-    }
+    resetColumns();
 }
 
 SynEditStringRec::SynEditStringRec():
     fString(),
     fObject(nullptr),
-    fRange{0,0,0,0,0},
+    fRange(emptyRangeState()),
     fColumns(-1)
 {
 }
@@ -723,6 +794,9 @@ SynEditStringRec::SynEditStringRec():
 SynEditUndoList::SynEditUndoList():QObject()
 {
     mMaxUndoActions = 1024;
+    mMaxMemoryUsage = 50 * 1024 * 1024;
+    mMemoryUsage = 0;
+    mMergeInserts = false;
     mNextChangeNumber = 1;
     mInsideRedo = false;
 
@@ -751,6 +825,23 @@ void SynEditUndoList::AddChange(SynChangeReason AReason, const BufferCoord &ASta
             }
         }
     }
+    // Continuous typing in a line is kept as one item, it's undone as a group anyway
+    if (mMergeInserts && !mInsideRedo
+            && AReason == SynChangeReason::crInsert && ChangeText.isEmpty()
+            && AStart.Line == AEnd.Line && mItems.count()>0) {
+        PSynEditUndoItem lastItem = mItems.last();
+        if (lastItem->changeReason() == SynChangeReason::crInsert
+                && lastItem->changeStr().isEmpty()
+                && lastItem->changeSelMode() == SelMode
+                && lastItem->changeStartPos().Line == AStart.Line
+                && lastItem->changeEndPos().Line == AStart.Line
+                && lastItem->changeEndPos().Char == AStart.Char
+                && lastItem->changeNumber() != mInitialChangeNumber) {
+            lastItem->mergeInsert(AEnd,changeNumber);
+            emit addedUndo();
+            return;
+        }
+    }
     PSynEditUndoItem  NewItem = std::make_shared<SynEditUndoItem>(AReason,
                                                                   SelMode,AStart,AEnd,ChangeText,
                                                                   changeNumber);
@@ -775,6 +866,7 @@ void SynEditUndoList::BeginBlock()
 void SynEditUndoList::Clear()
 {
     mItems.clear();
+    mMemoryUsage = 0;
     mFullUndoImposible = false;
 }
 
@@ -783,6 +875,7 @@ void SynEditUndoList::DeleteItem(int index)
     if (index <0 || index>=mItems.count()) {
         ListIndexOutOfBounds(index);
     }
+    mMemoryUsage -= mItems[index]->memoryUsage();
     mItems.removeAt(index);
 }
 
@@ -830,6 +923,7 @@ PSynEditUndoItem SynEditUndoList::PopItem()
     else {
         PSynEditUndoItem item = mItems.last();
         mItems.removeLast();
+        mMemoryUsage -= item->memoryUsage();
         return item;
     }
 }
@@ -839,6 +933,7 @@ void SynEditUndoList::PushItem(PSynEditUndoItem Item)
     if (!Item)
         return;
     mItems.append(Item);
+    mMemoryUsage += Item->memoryUsage();
     EnsureMaxEntries();
     if (Item->changeReason()!= SynChangeReason::crGroupBreak)
         emit addedUndo();
@@ -870,6 +965,26 @@ void SynEditUndoList::setMaxUndoActions(int maxUndoActions)
     mMaxUndoActions = maxUndoActions;
 }
 
+int SynEditUndoList::maxMemoryUsage() const
+{
+    return mMaxMemoryUsage;
+}
+
+void SynEditUndoList::setMaxMemoryUsage(int maxMemoryUsage)
+{
+    mMaxMemoryUsage = maxMemoryUsage;
+}
+
+bool SynEditUndoList::mergeInserts() const
+{
+    return mMergeInserts;
+}
+
+void SynEditUndoList::setMergeInserts(bool mergeInserts)
+{
+    mMergeInserts = mergeInserts;
+}
+
 bool SynEditUndoList::initialState()
 {
     if (ItemCount() == 0) {
@@ -908,7 +1023,10 @@ void SynEditUndoList::setItem(int index, PSynEditUndoItem Value)
     if (index <0 || index>=mItems.count()) {
         ListIndexOutOfBounds(index);
     }
+    mMemoryUsage -= mItems[index]->memoryUsage();
     mItems[index]=Value;
+    if (Value)
+        mMemoryUsage += Value->memoryUsage();
 }
 
 int SynEditUndoList::blockChangeNumber() const
@@ -943,11 +1061,19 @@ bool SynEditUndoList::fullUndoImposible() const
 
 void SynEditUndoList::EnsureMaxEntries()
 {
-    if (mItems.count() > mMaxUndoActions){
+    // the last change is kept even if it's larger than the memory limit
+    int removeCount = 0;
+    int memoryUsage = mMemoryUsage;
+    while (removeCount < mItems.count()
+           && (mItems.count() - removeCount > mMaxUndoActions
+               || (mItems.count() - removeCount > 1 && memoryUsage > mMaxMemoryUsage))) {
+        memoryUsage -= mItems[removeCount]->memoryUsage();
+        removeCount++;
+    }
+    if (removeCount > 0) {
         mFullUndoImposible = true;
-        while (mItems.count() > mMaxUndoActions) {
-            mItems.removeFirst();
-      }
+        mItems.remove(0,removeCount);
+        mMemoryUsage = memoryUsage;
     }
 }
 
@@ -976,6 +1102,17 @@ int SynEditUndoItem::changeNumber() const
     return mChangeNumber;
 }
 
+int SynEditUndoItem::memoryUsage() const
+{
+    return sizeof(SynEditUndoItem) + mChangeStr.size() * sizeof(QChar);
+}
+
+void SynEditUndoItem::mergeInsert(const BufferCoord &endPos, int number)
+{
+    mChangeEndPos = endPos;
+    mChangeNumber = number;
+}
+
 SynEditUndoItem::SynEditUndoItem(SynChangeReason reason, SynSelectionMode selMode,
                                  BufferCoord startPos, BufferCoord endPos,
                                  const QString &str, int number)
@@ -3,7 +3,9 @@
 
 #include <QStringList>
 #include "highlighter/base.h"
+#include <QMap>
 #include <QMutex>
+#include <QSet>
 #include <QVector>
 #include <memory>
 #include "MiscProcs.h"
@@ -18,10 +20,13 @@ enum SynEditStringFlag {
 
 typedef int SynEditStringFlags;
 
+// Range states are read only once stored, so lines with the same state can share it
+typedef std::shared_ptr<const SynRangeState> PSynRangeState;
+
 struct SynEditStringRec {
   QString fString;
   void * fObject;
-  SynRangeState fRange;
+  PSynRangeState fRange;
   int fColumns;  //
 
 public:
@@ -124,11 +129,16 @@ private:
     //int mCapacity;
     FileEndingType mFileEndingType;
     bool mAppendNewLineAtEOF;
-    int mIndexOfLongestLine;
+    QMap<int,int> mLineColumnsCount; // columns -> count of lines with known columns
+    QSet<SynEditStringRec*> mUncountedLines; // lines whose columns are not calculated yet
     int mUpdateCount;
     QRecursiveMutex mMutex;
 
-    int calculateLineColumns(int Index);
+    int calculateLineColumns(SynEditStringRec* line);
+    void uncountLineColumns(SynEditStringRec* line);
+    void lineAdded(SynEditStringRec* line);
+    void lineRemoved(SynEditStringRec* line);
+    PSynRangeState shareRange(int Index, const SynRangeState& range);
 };
 
 enum class SynChangeReason {crInsert, crPaste, crDragDropInsert,
@@ -169,6 +179,8 @@ public:
     BufferCoord changeEndPos() const;
     QString changeStr() const;
     int changeNumber() const;
+    int memoryUsage() const;
+    void mergeInsert(const BufferCoord& endPos, int number);
 };
 using PSynEditUndoItem = std::shared_ptr<SynEditUndoItem>;
 
@@ -197,6 +209,10 @@ public:
 
     int maxUndoActions() const;
     void setMaxUndoActions(int maxUndoActions);
+    int maxMemoryUsage() const;
+    void setMaxMemoryUsage(int maxMemoryUsage);
+    bool mergeInserts() const;
+    void setMergeInserts(bool mergeInserts);
     bool initialState();
     PSynEditUndoItem item(int index);
     void setInitialState(const bool Value);
@@ -223,6 +239,9 @@ protected:
     QVector<PSynEditUndoItem> mItems;
     int mLockCount;
     int mMaxUndoActions;
+    int mMaxMemoryUsage; // in bytes
+    int mMemoryUsage;
+    bool mMergeInserts;
     int mNextChangeNumber;
     int mInitialChangeNumber;
     bool mInsideRedo;
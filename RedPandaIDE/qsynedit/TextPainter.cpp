@@ -588,7 +588,7 @@ bool SynEditTextPainter::TokenIsSpaces(bool &bSpacesTest, const QString& Token,
 // record. This will paint any chars already stored if there is
 // a (visible) change in the attributes.
 void SynEditTextPainter::AddHighlightToken(const QString &Token, int ColumnsBefore,
-                                           int TokenColumns, int cLine, PSynHighlighterAttribute p_Attri)
+                                           int TokenColumns, int cLine, int cChar, PSynHighlighterAttribute p_Attri)
 {
     bool bCanAppend;
     QColor Foreground, Background;
@@ -615,7 +615,7 @@ void SynEditTextPainter::AddHighlightToken(const QString &Token, int ColumnsBefo
         Foreground = edit->mForegroundColor;
     }
 
-    edit->onPreparePaintHighlightToken(cLine,edit->mHighlighter->getTokenPos()+1,
+    edit->onPreparePaintHighlightToken(cLine,cChar,
         Token,p_Attri,Style,Foreground,Background);
 
     // Do we have to paint the old chars first, or can we just append?
@@ -784,6 +784,101 @@ void SynEditTextPainter::GetBraceColorAttr(int level, PSynHighlighterAttribute &
         attr = oldAttr;
 }
 
+// the part of the range state used by the highlighter to tokenize a line
+static bool isSameStartState(const SynRangeState& range1, const SynRangeState& range2)
+{
+    return range1.state == range2.state
+            && range1.spaceState == range2.spaceState
+            && range1.braceLevel == range2.braceLevel
+            && range1.bracketLevel == range2.bracketLevel
+            && range1.parenthesisLevel == range2.parenthesisLevel
+            && range1.indents == range2.indents;
+}
+
+PSynLineTokens SynEditTextPainter::getLineTokens(int vLine, const QString &sLine, bool useCache)
+{
+    if (vLine == 1) {
+        edit->mHighlighter->resetState();
+    } else {
+        edit->mHighlighter->setState(
+                    edit->mLines->ranges(vLine-2));
+    }
+    SynRangeState startRange = edit->mHighlighter->getRangeState();
+    if (vLine > edit->mLines->count())
+        useCache = false;
+    if (useCache) {
+        if (edit->mLineTokens.count() < edit->mLines->count())
+            edit->mLineTokens.resize(edit->mLines->count());
+        PSynLineTokens lineTokens = edit->mLineTokens[vLine-1];
+        if (lineTokens && lineTokens->line == sLine
+                && isSameStartState(lineTokens->startRange, startRange))
+            return lineTokens;
+    }
+
+    PSynLineTokens lineTokens = std::make_shared<SynLineTokens>();
+    lineTokens->line = sLine;
+    lineTokens->startRange = startRange;
+    // Initialize highlighter with line text and range info. It is
+    // necessary because we probably did not scan to the end of the last
+    // line - the internal highlighter range might be wrong.
+    edit->mHighlighter->setLine(sLine, vLine - 1);
+    int nextPos = 0;
+    int nextColumnsBefore = 0;
+    while (!edit->mHighlighter->eol()) {
+        QString sToken = edit->mHighlighter->getToken();
+        // Work-around buggy highlighters which return empty tokens.
+        if (sToken.isEmpty())  {
+            edit->mHighlighter->next();
+            if (edit->mHighlighter->eol())
+                break;
+            sToken = edit->mHighlighter->getToken();
+            // Maybe should also test whether GetTokenPos changed...
+            if (sToken.isEmpty()) {
+                qDebug()<<SynEdit::tr("The highlighter seems to be in an infinite loop");
+                throw BaseError(SynEdit::tr("The highlighter seems to be in an infinite loop"));
+            }
+        }
+        SynLineToken token;
+        token.text = sToken;
+        token.pos = edit->mHighlighter->getTokenPos();
+        // tokens are usually adjacent, no need to count the columns from the line start
+        if (token.pos == nextPos)
+            token.columnsBefore = nextColumnsBefore;
+        else
+            token.columnsBefore = edit->charToColumn(sLine,token.pos+1)-1;
+        token.columns = edit->stringColumns(sToken, token.columnsBefore);
+        token.attr = edit->mHighlighter->getTokenAttribute();
+        token.braceLevel = -1;
+        if (sToken == "["
+                || sToken == "("
+                || sToken == "{"
+                ) {
+            SynRangeState rangeState = edit->mHighlighter->getRangeState();
+            token.braceLevel = rangeState.bracketLevel
+                    +rangeState.braceLevel
+                    +rangeState.parenthesisLevel;
+        } else if (sToken == "]"
+                   || sToken == ")"
+                   || sToken == "}"
+                   ){
+            SynRangeState rangeState = edit->mHighlighter->getRangeState();
+            token.braceLevel = rangeState.bracketLevel
+                    +rangeState.braceLevel
+                    +rangeState.parenthesisLevel+1;
+        }
+        nextPos = token.pos + sToken.length();
+        nextColumnsBefore = token.columnsBefore + token.columns;
+        lineTokens->tokens.append(token);
+        // Let the highlighter scan the next token.
+        edit->mHighlighter->next();
+    }
+    lineTokens->endPos = edit->mHighlighter->getTokenPos();
+    lineTokens->endBraceLevel = edit->mHighlighter->getRangeState().braceLevel;
+    if (useCache)
+        edit->mLineTokens[vLine-1] = lineTokens;
+    return lineTokens;
+}
+
 void SynEditTextPainter::PaintLines()
 {
     int cRow; // row index for the loop
@@ -915,69 +1010,37 @@ void SynEditTextPainter::PaintLines()
                   PaintEditAreas(areaList);
               }
         } else {
-            // Initialize highlighter with line text and range info. It is
-            // necessary because we probably did not scan to the end of the last
-            // line - the internal highlighter range might be wrong.
-            if (vLine == 1) {
-                edit->mHighlighter->resetState();
-            } else {
-                edit->mHighlighter->setState(
-                            edit->mLines->ranges(vLine-2));
-            }
-            edit->mHighlighter->setLine(sLine, vLine - 1);
+            // Reuse the tokens of the line if it's not changed since the last
+            // paint. Lines with the input method's preedit string are not cached.
+            PSynLineTokens lineTokens = getLineTokens(vLine, sLine,
+                    !bCurrentLine || edit->mInputPreeditString.isEmpty());
             // Try to concatenate as many tokens as possible to minimize the count
             // of ExtTextOut calls necessary. This depends on the selection state
             // or the line having special colors. For spaces the foreground color
             // is ignored as well.
             TokenAccu.Columns = 0;
             nTokenColumnsBefore = 0;
+            bool allTokensPainted = true;
+            int lineEndColumns = 0;
             // Test first whether anything of this token is visible.
-            while (!edit->mHighlighter->eol()) {
-                sToken = edit->mHighlighter->getToken();
-                // Work-around buggy highlighters which return empty tokens.
-                if (sToken.isEmpty())  {
-                    edit->mHighlighter->next();
-                    if (edit->mHighlighter->eol())
-                        break;
-                    sToken = edit->mHighlighter->getToken();
-                    // Maybe should also test whether GetTokenPos changed...
-                    if (sToken.isEmpty()) {
-                        qDebug()<<SynEdit::tr("The highlighter seems to be in an infinite loop");
-                        throw BaseError(SynEdit::tr("The highlighter seems to be in an infinite loop"));
-                    }
-                }
-                nTokenColumnsBefore = edit->charToColumn(sLine,edit->mHighlighter->getTokenPos()+1)-1;
-                nTokenColumnLen = edit->stringColumns(sToken, nTokenColumnsBefore);
+            for (const SynLineToken& token: lineTokens->tokens) {
+                nTokenColumnsBefore = token.columnsBefore;
+                nTokenColumnLen = token.columns;
                 if (nTokenColumnsBefore + nTokenColumnLen >= vFirstChar) {
                     if (nTokenColumnsBefore + nTokenColumnLen >= vLastChar) {
-                        if (nTokenColumnsBefore >= vLastChar)
+                        if (nTokenColumnsBefore >= vLastChar) {
+                            allTokensPainted = false;
                             break; //*** BREAK ***
+                        }
                         nTokenColumnLen = vLastChar - nTokenColumnsBefore - 1;
                     }
                     // It's at least partially visible. Get the token attributes now.
-                    attr = edit->mHighlighter->getTokenAttribute();
-                    if (sToken == "["
-                            || sToken == "("
-                            || sToken == "{"
-                            ) {
-                        SynRangeState rangeState = edit->mHighlighter->getRangeState();
-                        GetBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel
-                                          ,attr);
-                    } else if (sToken == "]"
-                               || sToken == ")"
-                               || sToken == "}"
-                               ){
-                        SynRangeState rangeState = edit->mHighlighter->getRangeState();
-                        GetBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel+1,
-                                          attr);
-                    }
+                    attr = token.attr;
+                    if (token.braceLevel>=0)
+                        GetBraceColorAttr(token.braceLevel,attr);
                     if (bCurrentLine && edit->mInputPreeditString.length()>0) {
-                        int startPos = edit->mHighlighter->getTokenPos()+1;
-                        int endPos = edit->mHighlighter->getTokenPos() + sToken.length();
+                        int startPos = token.pos+1;
+                        int endPos = token.pos + token.text.length();
                         //qDebug()<<startPos<<":"<<endPos<<" - "+sToken+" - "<<edit->mCaretX<<":"<<edit->mCaretX+edit->mInputPreeditString.length();
                         if (!(endPos < edit->mCaretX
                                 || startPos >= edit->mCaretX+edit->mInputPreeditString.length())) {
@@ -988,15 +1051,13 @@ void SynEditTextPainter::PaintLines()
                             }
                         }
                     }
-                    AddHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-                      nTokenColumnLen, vLine,attr);
+                    AddHighlightToken(token.text, nTokenColumnsBefore - (vFirstChar - FirstCol),
+                      nTokenColumnLen, vLine, token.pos+1, attr);
                 }
-                // Let the highlighter scan the next token.
-                edit->mHighlighter->next();
+                lineEndColumns = token.columnsBefore + token.columns;
             }
-            // Don't assume HL.GetTokenPos is valid after HL.GetEOL == True.
-            nTokenColumnsBefore += edit->stringColumns(sToken,nTokenColumnsBefore-1);
-            if (edit->mHighlighter->eol() && (nTokenColumnsBefore < vLastChar)) {
+            nTokenColumnsBefore = lineEndColumns;
+            if (allTokensPainted && (nTokenColumnsBefore < vLastChar)) {
                 int lineColumns = edit->mLines->lineColumns(vLine-1);
                 // Draw text that couldn't be parsed by the highlighter, if any.
                 if (nTokenColumnsBefore < lineColumns) {
@@ -1006,7 +1067,7 @@ void SynEditTextPainter::PaintLines()
                     if (nTokenColumnLen > 0) {
                         sToken = edit->substringByColumns(sLine,nTokenColumnsBefore+1,nTokenColumnLen);
                         AddHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-                            nTokenColumnLen, vLine, PSynHighlighterAttribute());
+                            nTokenColumnLen, vLine, lineTokens->endPos+1, PSynHighlighterAttribute());
                     }
                 }
                 // Draw LineBreak glyph.
@@ -1014,7 +1075,8 @@ void SynEditTextPainter::PaintLines()
                     (!bSpecialLine) && (edit->mLines->lineColumns(vLine-1) < vLastChar)) {
                     AddHighlightToken(SynLineBreakGlyph,
                       edit->mLines->lineColumns(vLine-1)  - (vFirstChar - FirstCol),
-                      edit->charColumns(SynLineBreakGlyph),vLine, edit->mHighlighter->whitespaceAttribute());
+                      edit->charColumns(SynLineBreakGlyph),vLine, lineTokens->endPos+1,
+                      edit->mHighlighter->whitespaceAttribute());
                 }
             }
 
@@ -1024,9 +1086,9 @@ void SynEditTextPainter::PaintLines()
                 sFold = " ... } ";
                 nFold = edit->stringColumns(sFold,edit->mLines->lineColumns(vLine-1));
                 attr = edit->mHighlighter->symbolAttribute();
-                GetBraceColorAttr(edit->mHighlighter->getRangeState().braceLevel,attr);
+                GetBraceColorAttr(lineTokens->endBraceLevel,attr);
                 AddHighlightToken(sFold,edit->mLines->lineColumns(vLine-1)+1 - (vFirstChar - FirstCol)
-                  , nFold, vLine, attr);
+                  , nFold, vLine, lineTokens->endPos+1, attr);
             }
 
             // Draw anything that's left in the TokenAccu record. Fill to the end
@@ -4,11 +4,33 @@
 #include <QColor>
 #include <QPainter>
 #include <QString>
+#include <QVector>
 #include "Types.h"
 #include "highlighter/base.h"
 #include "../utils.h"
 #include "MiscClasses.h"
 
+// A highlighter token of a painted line
+struct SynLineToken {
+    QString text;
+    int pos; // char position in the line (0-based), as returned by getTokenPos()
+    int columnsBefore;
+    int columns;
+    PSynHighlighterAttribute attr;
+    int braceLevel; // level for the rainbow color, -1 if the token is not a brace
+};
+
+// Tokens of a painted line, reused while the line and the highlighter state
+// at its beginning are not changed
+struct SynLineTokens {
+    QString line;
+    SynRangeState startRange;
+    QVector<SynLineToken> tokens;
+    int endPos; // getTokenPos() at the end of line
+    int endBraceLevel;
+};
+using PSynLineTokens = std::shared_ptr<SynLineTokens>;
+
 class SynEdit;
 class SynEditTextPainter
 {
@@ -38,7 +60,8 @@ private:
     void PaintHighlightToken(bool bFillToEOL);
     bool TokenIsSpaces(bool& bSpacesTest, const QString& Token, bool& bIsSpaces);
     void AddHighlightToken(const QString& Token, int ColumnsBefore, int TokenColumns,
-                           int cLine, PSynHighlighterAttribute p_Attri);
+                           int cLine, int cChar, PSynHighlighterAttribute p_Attri);
+    PSynLineTokens getLineTokens(int vLine, const QString& sLine, bool useCache);
 
     void PaintFoldAttributes();
     void GetBraceColorAttr(int level, PSynHighlighterAttribute &attr);
@@ -3128,6 +3128,16 @@ void Settings::CodeCompletion::setIgnoreCase(bool newIgnoreCase)
     mIgnoreCase = newIgnoreCase;
 }
 
+bool Settings::CodeCompletion::fuzzyMatch() const
+{
+    return mFuzzyMatch;
+}
+
+void Settings::CodeCompletion::setFuzzyMatch(bool newFuzzyMatch)
+{
+    mFuzzyMatch = newFuzzyMatch;
+}
+
 bool Settings::CodeCompletion::showKeywords() const
 {
     return mShowKeywords;
@@ -3230,6 +3240,7 @@ void Settings::CodeCompletion::doSave()
     saveValue("sort_by_scope",mSortByScope);
     saveValue("show_keywords",mShowKeywords);
     saveValue("ignore_case",mIgnoreCase);
+    saveValue("fuzzy_match",mFuzzyMatch);
     saveValue("append_func",mAppendFunc);
     saveValue("show_code_ins",mShowCodeIns);
 }
@@ -3248,6 +3259,7 @@ void Settings::CodeCompletion::doLoad()
     mSortByScope = boolValue("sort_by_scope",true);
     mShowKeywords = boolValue("show_keywords",true);
     mIgnoreCase = boolValue("ignore_case",true);
+    mFuzzyMatch = boolValue("fuzzy_match",false);
     mAppendFunc = boolValue("append_func",true);
     mShowCodeIns = boolValue("show_code_ins",true);
 }
@@ -515,6 +515,9 @@ public:
         bool ignoreCase() const;
         void setIgnoreCase(bool newIgnoreCase);
 
+        bool fuzzyMatch() const;
+        void setFuzzyMatch(bool newFuzzyMatch);
+
         bool appendFunc() const;
         void setAppendFunc(bool newAppendFunc);
 
@@ -532,6 +535,7 @@ public:
         bool mSortByScope;
         bool mShowKeywords;
         bool mIgnoreCase;
+        bool mFuzzyMatch;
         bool mAppendFunc;
         bool mShowCodeIns;
 
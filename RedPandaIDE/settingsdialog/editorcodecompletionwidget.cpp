@@ -32,6 +32,7 @@ void EditorCodeCompletionWidget::doLoad()
     ui->chkSortByScope->setChecked(pSettings->codeCompletion().sortByScope());
     ui->chkShowKeywords->setChecked(pSettings->codeCompletion().showKeywords());
     ui->chkIgnoreCases->setChecked(pSettings->codeCompletion().ignoreCase());
+    ui->chkFuzzyMatch->setChecked(pSettings->codeCompletion().fuzzyMatch());
     ui->chkAppendFunc->setChecked(pSettings->codeCompletion().appendFunc());
     ui->chkShowCodeIns->setChecked(pSettings->codeCompletion().showCodeIns());
 }
@@ -52,6 +53,7 @@ void EditorCodeCompletionWidget::doSave()
     pSettings->codeCompletion().setSortByScope(ui->chkSortByScope->isChecked());
     pSettings->codeCompletion().setShowKeywords(ui->chkShowKeywords->isChecked());
     pSettings->codeCompletion().setIgnoreCase(ui->chkIgnoreCases->isChecked());
+    pSettings->codeCompletion().setFuzzyMatch(ui->chkFuzzyMatch->isChecked());
     pSettings->codeCompletion().setAppendFunc(ui->chkAppendFunc->isChecked());
     pSettings->codeCompletion().setShowCodeIns(ui->chkShowCodeIns->isChecked());
 
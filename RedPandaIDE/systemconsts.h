@@ -50,6 +50,7 @@
 #define DEV_BOOKMARK_FILE "bookmarks.json"
 #define DEV_BREAKPOINTS_FILE "breakpoints.json"
 #define DEV_WATCH_FILE "watch.json"
+#define DEV_PARSER_CACHE_DIR "parsercache"
 
 #ifdef Q_OS_WIN
 #   define PATH_SENSITIVITY Qt::CaseInsensitive
@@ -593,6 +593,9 @@ void resetCppParser(std::shared_ptr<CppParser> parser)
         parser->addHardDefineByLine("#define __TIME__  1");
     }
     parser->parseHardDefines();
+    parser->setSystemHeaderCacheDir(includeTrailingPathDelimiter(pSettings->dirs().config())
+                                    + DEV_PARSER_CACHE_DIR);
+    parser->loadSystemHeaderCache();
     pMainWindow->disconnect(parser.get(),
                             &CppParser::onStartParsing,
                             pMainWindow,
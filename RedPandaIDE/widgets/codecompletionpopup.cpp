@@ -45,6 +45,7 @@ CodeCompletionPopup::CodeCompletionPopup(QWidget *parent) :
     mShowCodeSnippets = true;
 
     mIgnoreCase = false;
+    mFuzzyMatch = false;
 
 }
 
@@ -59,7 +60,8 @@ void CodeCompletionPopup::setKeypressedCallback(const KeyPressedCallback &newKey
     mListView->setKeypressedCallback(newKeypressedCallback);
 }
 
-void CodeCompletionPopup::prepareSearch(const QString &phrase, const QString &filename, int line)
+void CodeCompletionPopup::prepareSearch(const QString &phrase, const QString &filename, int line,
+                                        const QString &blockSignature)
 {
     QMutexLocker locker(&mMutex);
     if (!isEnabled())
@@ -69,8 +71,35 @@ void CodeCompletionPopup::prepareSearch(const QString &phrase, const QString &fi
     QCursor oldCursor = cursor();
     setCursor(Qt::CursorShape::WaitCursor);
 
-    mIncludedFiles = mParser->getFileIncludes(filename);
-    getCompletionFor(filename,phrase,line);
+    // the list doesn't depend on the member being typed
+    int i = mParser->findLastOperator(phrase);
+    while ((i>=0) && (i<phrase.length()) && (
+               phrase[i] == '.'
+               || phrase[i] == ':'
+               || phrase[i] == '-'
+               || phrase[i] == '>'))
+        i++;
+    // The parser can't find the scope while it's parsing, and the line may be
+    // shifted by the edits being parsed, so the blocks around it are used
+    QString key = QString("%1:%2:%3")
+            .arg(filename, blockSignature, i<0?QString():phrase.left(i));
+    if (mParser->parsing() && key == mLastCompletionKey) {
+        // The parser can't be queried while it's parsing, use the list got
+        // at the same place from the last complete parse results
+        mIncludedFiles = mLastIncludedFiles;
+        mUsings = mLastUsings;
+        mFullCompletionStatementList = mLastFullCompletionStatementList;
+    } else {
+        mIncludedFiles = mParser->getFileIncludes(filename);
+        getCompletionFor(filename,phrase,line);
+        if (!mParser->parsing()) {
+            mLastCompletionKey = key;
+            mLastIncludedFiles = mIncludedFiles;
+            mLastUsings = mUsings;
+            mLastFullCompletionStatementList = mFullCompletionStatementList;
+        }
+    }
+    buildCompletionIndex();
 
     //todo: notify model
 //CodeComplForm.lbCompletion.Font.Size := FontSize;
@@ -195,16 +224,98 @@ void CodeCompletionPopup::addStatement(PStatement statement, const QString &file
     mFullCompletionStatementList.append(statement);
 }
 
-static bool nameComparator(PStatement statement1,PStatement statement2) {
-    if (statement1->caseMatch && !statement2->caseMatch) {
+// prefix matches are always shown before fuzzy matches
+#define PREFIX_MATCH_SCORE 100000
+
+// bits for letters, digits and '_' used in the (case folded) text, other chars share the last bit
+static quint64 charMask(const QString& text)
+{
+    quint64 mask = 0;
+    foreach (const QChar& ch, text) {
+        ushort c = ch.unicode();
+        if (c>='a' && c<='z')
+            mask |= (quint64)1 << (c-'a');
+        else if (c>='0' && c<='9')
+            mask |= (quint64)1 << (26+c-'0');
+        else if (c=='_')
+            mask |= (quint64)1 << 36;
+        else
+            mask |= (quint64)1 << 63;
+    }
+    return mask;
+}
+
+static bool isWordStart(const QString& text, int i)
+{
+    if (i==0)
+        return true;
+    QChar ch = text[i];
+    QChar prev = text[i-1];
+    if (prev == '_')
+        return ch != '_';
+    if (ch.isUpper() && !prev.isUpper())
         return true;
-    } else if (!statement1->caseMatch && statement2->caseMatch) {
+    return ch.isDigit() && !prev.isDigit();
+}
+
+// Score how well pattern matches command as a subsequence ("pbk" -> "push_back").
+// Chars at the start of words (after '_', camelCase humps) and consecutive chars
+// score higher. The first char must start a word. Returns -1 if not matched.
+static int fuzzyMatchScore(const QString& command, const QString& pattern, bool ignoreCase)
+{
+    auto charAt=[&command,ignoreCase](int i) {
+        return ignoreCase?command[i].toCaseFolded():command[i];
+    };
+    int score = 0;
+    int pos = -1; // last matched position
+    for (int i=0;i<pattern.length();i++) {
+        QChar ch = pattern[i];
+        if (pos>=0 && pos+1<command.length() && charAt(pos+1)==ch) {
+            pos++;
+            score += 8;
+            continue;
+        }
+        int found = -1;
+        for (int j=pos+1;j<command.length();j++) {
+            if (charAt(j)==ch && isWordStart(command,j)) {
+                found = j;
+                break;
+            }
+        }
+        if (found>=0) {
+            score += 16;
+        } else {
+            if (i==0)
+                return -1;
+            for (int j=pos+1;j<command.length();j++) {
+                if (charAt(j)==ch) {
+                    found = j;
+                    break;
+                }
+            }
+            if (found<0)
+                return -1;
+            score += 1;
+        }
+        if (pos>=0)
+            score -= qMin(found-pos-1,8); // skipped chars
+        pos = found;
+    }
+    return qMax(score,0);
+}
+
+static bool nameComparator(const CompletionMatch& match1,const CompletionMatch& match2) {
+    if (match1.caseMatch && !match2.caseMatch) {
+        return true;
+    } else if (!match1.caseMatch && match2.caseMatch) {
         return false;
     } else
-        return statement1->command < statement2->command;
+        return match1.statement->command < match2.statement->command;
 }
 
-static bool defaultComparator(PStatement statement1,PStatement statement2) {
+static bool defaultComparator(const CompletionMatch& match1,const CompletionMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -213,6 +324,9 @@ static bool defaultComparator(PStatement statement1,PStatement statement2) {
             return statement1->command < statement2->command;
     } else if (statement2->kind == StatementKind::skUserCodeSnippet) {
         return false;
+        // show better matches first
+    } else if (match1.matchScore != match2.matchScore) {
+        return match1.matchScore > match2.matchScore;
         // show keywords first
     } else if ((statement1->kind == StatementKind::skKeyword)
                && (statement2->kind != StatementKind::skKeyword)) {
@@ -221,10 +335,12 @@ static bool defaultComparator(PStatement statement1,PStatement statement2) {
                && (statement2->kind == StatementKind::skKeyword)) {
         return false;
     } else
-        return nameComparator(statement1,statement2);
+        return nameComparator(match1,match2);
 }
 
-static bool sortByScopeComparator(PStatement statement1,PStatement statement2){
+static bool sortByScopeComparator(const CompletionMatch& match1,const CompletionMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -233,6 +349,9 @@ static bool sortByScopeComparator(PStatement statement1,PStatement statement2){
             return statement1->command < statement2->command;
     } else if (statement2->kind == StatementKind::skUserCodeSnippet) {
         return false;
+        // show better matches first
+    } else if (match1.matchScore != match2.matchScore) {
+        return match1.matchScore > match2.matchScore;
         // show keywords first
     } else if (statement1->kind == StatementKind::skKeyword) {
         if (statement2->kind != StatementKind::skKeyword)
@@ -254,10 +373,12 @@ static bool sortByScopeComparator(PStatement statement1,PStatement statement2){
                && statement2->scope != StatementScope::ssGlobal ) {
         return false;
     } else
-        return nameComparator(statement1,statement2);
+        return nameComparator(match1,match2);
 }
 
-static bool sortWithUsageComparator(PStatement statement1,PStatement statement2) {
+static bool sortWithUsageComparator(const CompletionMatch& match1,const CompletionMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -266,6 +387,9 @@ static bool sortWithUsageComparator(PStatement statement1,PStatement statement2)
             return statement1->command < statement2->command;
     } else if (statement2->kind == StatementKind::skUserCodeSnippet) {
         return false;
+        // show better matches first
+    } else if (match1.matchScore != match2.matchScore) {
+        return match1.matchScore > match2.matchScore;
         //show most freq first
     } else if (statement1->freqTop > statement2->freqTop) {
         return true;
@@ -279,10 +403,12 @@ static bool sortWithUsageComparator(PStatement statement1,PStatement statement2)
                && (statement2->kind != StatementKind::skKeyword)) {
         return false;
     } else
-        return nameComparator(statement1,statement2);
+        return nameComparator(match1,match2);
 }
 
-static bool sortByScopeWithUsageComparator(PStatement statement1,PStatement statement2){
+static bool sortByScopeWithUsageComparator(const CompletionMatch& match1,const CompletionMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -291,6 +417,9 @@ static bool sortByScopeWithUsageComparator(PStatement statement1,PStatement stat
             return statement1->command < statement2->command;
     } else if (statement2->kind == StatementKind::skUserCodeSnippet) {
         return false;
+        // show better matches first
+    } else if (match1.matchScore != match2.matchScore) {
+        return match1.matchScore > match2.matchScore;
         //show most freq first
     } else if (statement1->freqTop > statement2->freqTop) {
         return true;
@@ -317,7 +446,7 @@ static bool sortByScopeWithUsageComparator(PStatement statement1,PStatement stat
                && statement2->scope != StatementScope::ssGlobal ) {
         return false;
     } else
-        return nameComparator(statement1,statement2);
+        return nameComparator(match1,match2);
 }
 
 void CodeCompletionPopup::filterList(const QString &member)
@@ -341,41 +470,56 @@ void CodeCompletionPopup::filterList(const QString &member)
 //        }
 
     mCompletionStatementList.clear();
+    // scores are kept here, the statements are shared with the parser and other popups
+    QVector<CompletionMatch> matches;
     if (!member.isEmpty()) { // filter
-        mCompletionStatementList.reserve(mFullCompletionStatementList.size());
-        foreach (const PStatement& statement, mFullCompletionStatementList) {
-            Qt::CaseSensitivity cs = (mIgnoreCase?
-                                          Qt::CaseInsensitive:
-                                          Qt::CaseSensitive);
-            if (statement->command.startsWith(member, cs)) {
-                if (mIgnoreCase) {
-                    statement->caseMatch =
-                            statement->command.startsWith(
-                                member,Qt::CaseSensitive);
-                } else {
-                    statement->caseMatch = true;
+        // statements starting with member are adjacent in the index
+        QString key = member.toCaseFolded();
+        auto prefixBegin = std::lower_bound(mCompletionIndex.cbegin(),mCompletionIndex.cend(),key,
+                                     [](const CompletionIndexItem& item, const QString& key) {
+            return item.foldedCommand < key;
+        });
+        auto prefixEnd = prefixBegin;
+        for (;prefixEnd!=mCompletionIndex.cend() && prefixEnd->foldedCommand.startsWith(key);++prefixEnd) {
+            const PStatement& statement = prefixEnd->statement;
+            bool caseMatch = statement->command.startsWith(member,Qt::CaseSensitive);
+            if (!mIgnoreCase && !caseMatch)
+                continue;
+            matches.append(CompletionMatch{statement,PREFIX_MATCH_SCORE,caseMatch});
+        }
+        // a single letter would match too many statements
+        if (mFuzzyMatch && member.length()>1) {
+            QString pattern = mIgnoreCase?key:member;
+            quint64 mask = charMask(key);
+            for (auto iter=mCompletionIndex.cbegin();iter!=mCompletionIndex.cend();++iter) {
+                if (iter==prefixBegin) {
+                    // already matched by prefix
+                    iter = prefixEnd;
+                    if (iter==mCompletionIndex.cend())
+                        break;
                 }
-                mCompletionStatementList.append(statement);
+                if ((iter->charMask & mask)!=mask)
+                    continue;
+                int score = fuzzyMatchScore(iter->statement->command,pattern,mIgnoreCase);
+                if (score<0)
+                    continue;
+                matches.append(CompletionMatch{iter->statement,score,false});
             }
         }
-    } else
-        mCompletionStatementList.append(mFullCompletionStatementList);
+    } else {
+        matches.reserve(mFullCompletionStatementList.size());
+        foreach (const PStatement& statement, mFullCompletionStatementList) {
+            matches.append(CompletionMatch{statement,PREFIX_MATCH_SCORE,false});
+        }
+    }
     if (mRecordUsage) {
         int topCount = 0;
         int secondCount = 0;
         int thirdCount = 0;
-        int usageCount;
-        foreach (const PStatement& statement,mCompletionStatementList) {
-            if (statement->usageCount == -1) {
-                PSymbolUsage usage = pMainWindow->symbolUsageManager()->findUsage(statement->fullName);
-                if (usage) {
-                    usageCount = usage->count;
-                } else {
-                    usageCount = 0;
-                }
-                statement->usageCount = usageCount;
-            } else
-                usageCount = statement->usageCount;
+        foreach (const CompletionMatch& match,matches) {
+            const PStatement& statement = match.statement;
+            // usage counts are found in buildCompletionIndex()
+            int usageCount = statement->usageCount;
             if (usageCount>topCount) {
                 thirdCount = secondCount;
                 secondCount = topCount;
@@ -391,7 +535,8 @@ void CodeCompletionPopup::filterList(const QString &member)
                 thirdCount = usageCount;
             }
         }
-        foreach (const PStatement& statement, mCompletionStatementList) {
+        foreach (const CompletionMatch& match, matches) {
+            const PStatement& statement = match.statement;
             if (statement->usageCount == 0) {
                 statement->freqTop = 0;
             } else if  (statement->usageCount == topCount) {
@@ -403,26 +548,55 @@ void CodeCompletionPopup::filterList(const QString &member)
             }
         }
         if (mSortByScope) {
-            std::sort(mCompletionStatementList.begin(),
-                      mCompletionStatementList.end(),
+            std::sort(matches.begin(),
+                      matches.end(),
                       sortByScopeWithUsageComparator);
         } else {
-            std::sort(mCompletionStatementList.begin(),
-                      mCompletionStatementList.end(),
+            std::sort(matches.begin(),
+                      matches.end(),
                       sortWithUsageComparator);
         }
     } else if (mSortByScope) {
-        std::sort(mCompletionStatementList.begin(),
-                  mCompletionStatementList.end(),
+        std::sort(matches.begin(),
+                  matches.end(),
                   sortByScopeComparator);
     } else {
-        std::sort(mCompletionStatementList.begin(),
-                  mCompletionStatementList.end(),
+        std::sort(matches.begin(),
+                  matches.end(),
                   defaultComparator);
     }
+    mCompletionStatementList.reserve(matches.size());
+    foreach (const CompletionMatch& match, matches) {
+        mCompletionStatementList.append(match.statement);
+    }
     //    }
 }
 
+void CodeCompletionPopup::buildCompletionIndex()
+{
+    mCompletionIndex.clear();
+    mCompletionIndex.reserve(mFullCompletionStatementList.size());
+    foreach (const PStatement& statement, mFullCompletionStatementList) {
+        CompletionIndexItem item;
+        item.foldedCommand = statement->command.toCaseFolded();
+        item.charMask = charMask(item.foldedCommand);
+        item.statement = statement;
+        mCompletionIndex.append(item);
+        if (mRecordUsage && statement->usageCount == -1) {
+            PSymbolUsage usage = pMainWindow->symbolUsageManager()->findUsage(statement->fullName);
+            if (usage) {
+                statement->usageCount = usage->count;
+            } else {
+                statement->usageCount = 0;
+            }
+        }
+    }
+    std::sort(mCompletionIndex.begin(),mCompletionIndex.end(),
+              [](const CompletionIndexItem& item1, const CompletionIndexItem& item2) {
+        return item1.foldedCommand < item2.foldedCommand;
+    });
+}
+
 void CodeCompletionPopup::getCompletionFor(const QString &fileName, const QString &phrase, int line)
 {
     if(!mParser)
@@ -813,6 +987,16 @@ void CodeCompletionPopup::setIgnoreCase(bool newIgnoreCase)
     mIgnoreCase = newIgnoreCase;
 }
 
+bool CodeCompletionPopup::fuzzyMatch() const
+{
+    return mFuzzyMatch;
+}
+
+void CodeCompletionPopup::setFuzzyMatch(bool newFuzzyMatch)
+{
+    mFuzzyMatch = newFuzzyMatch;
+}
+
 bool CodeCompletionPopup::showCodeSnippets() const
 {
     return mShowCodeSnippets;
@@ -870,6 +1054,12 @@ const PCppParser &CodeCompletionPopup::parser() const
 
 void CodeCompletionPopup::setParser(const PCppParser &newParser)
 {
+    if (mParser != newParser) {
+        mLastCompletionKey.clear();
+        mLastIncludedFiles.clear();
+        mLastUsings.clear();
+        mLastFullCompletionStatementList.clear();
+    }
     mParser = newParser;
 }
 
@@ -879,6 +1069,7 @@ void CodeCompletionPopup::hideEvent(QHideEvent *event)
     mListView->setKeypressedCallback(nullptr);
     mCompletionStatementList.clear();
     mFullCompletionStatementList.clear();
+    mCompletionIndex.clear();
     mIncludedFiles.clear();
     mUsings.clear();
     mAddedStatements.clear();
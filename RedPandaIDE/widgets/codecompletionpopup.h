@@ -7,6 +7,19 @@
 #include "codecompletionlistview.h"
 
 class ColorSchemeItem;
+
+struct CompletionIndexItem {
+    QString foldedCommand; // case folded command of the statement
+    quint64 charMask; // chars used in the command, to quickly skip candidates in fuzzy match
+    PStatement statement;
+};
+
+struct CompletionMatch {
+    PStatement statement;
+    int matchScore; // how well it matches the typed text
+    bool caseMatch; // if match with case
+};
+
 class CodeCompletionListModel : public QAbstractListModel {
     Q_OBJECT
 public:
@@ -31,7 +44,8 @@ public:
     ~CodeCompletionPopup();
 
     void setKeypressedCallback(const KeyPressedCallback &newKeypressedCallback);
-    void prepareSearch(const QString& phrase, const QString& filename, int line);
+    void prepareSearch(const QString& phrase, const QString& filename, int line,
+                       const QString& blockSignature);
     bool search(const QString& phrase, bool autoHideOnSingleResult);
 
     PStatement selectedStatement();
@@ -57,6 +71,9 @@ public:
     bool ignoreCase() const;
     void setIgnoreCase(bool newIgnoreCase);
 
+    bool fuzzyMatch() const;
+    void setFuzzyMatch(bool newFuzzyMatch);
+
     bool sortByScope() const;
     void setSortByScope(bool newSortByScope);
 
@@ -73,6 +90,7 @@ private:
                      int line);
     void addStatement(PStatement statement, const QString& fileName, int line);
     void filterList(const QString& member);
+    void buildCompletionIndex();
     void getCompletionFor(const QString& fileName,const QString& phrase, int line);
     bool isIncluded(const QString& fileName);
 private:
@@ -82,9 +100,15 @@ private:
     //QList<PStatement> mCodeInsStatements; //temporary (user code template) statements created when show code suggestion
     StatementList mFullCompletionStatementList;
     StatementList mCompletionStatementList;
+    QVector<CompletionIndexItem> mCompletionIndex; // sorted by folded command
     QSet<QString> mIncludedFiles;
     QSet<QString> mUsings;
     QSet<QString> mAddedStatements;
+    // last list got from the parser, used while the parser is parsing
+    QString mLastCompletionKey;
+    StatementList mLastFullCompletionStatementList;
+    QSet<QString> mLastIncludedFiles;
+    QSet<QString> mLastUsings;
     QString mPhrase;
     QRecursiveMutex mMutex;
     std::shared_ptr<QHash<StatementKind, std::shared_ptr<ColorSchemeItem> > > mColors;
@@ -97,6 +121,7 @@ private:
     bool mShowKeywords;
     bool mShowCodeSnippets;
     bool mIgnoreCase;
+    bool mFuzzyMatch;
     bool mSortByScope;
     bool mUseCppKeyword;
 
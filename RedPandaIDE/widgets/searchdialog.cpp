@@ -7,8 +7,10 @@
 #include "../qsynedit/Search.h"
 #include "../qsynedit/SearchRegex.h"
 #include "../project.h"
+#include <QByteArrayMatcher>
 #include <QMessageBox>
 #include <QDebug>
+#include <QtConcurrent>
 
 
 SearchDialog::SearchDialog(QWidget *parent) :
@@ -28,10 +30,19 @@ SearchDialog::SearchDialog(QWidget *parent) :
     mSearchOptions&=0;
     mBasicSearchEngine= PSynSearchBase(new SynSearch());
     mRegexSearchEngine= PSynSearchBase(new SynSearchRegex());
+    connect(&mFindInFilesWatcher, &QFutureWatcherBase::resultReadyAt,
+            this, &SearchDialog::onFindInFilesResultReady);
+    connect(&mFindInFilesWatcher, &QFutureWatcherBase::finished,
+            this, &SearchDialog::onFindInFilesFinished);
+    connect(pMainWindow->searchResultModel(), &SearchResultModel::modelChanged,
+            this, &SearchDialog::onSearchResultsChanged);
+    mFindInFilesCount = 0;
+    mFindInFilesFileHitted = 0;
 }
 
 SearchDialog::~SearchDialog()
 {
+    cancelFindInFiles();
     delete ui;
 }
 
@@ -262,6 +273,7 @@ void SearchDialog::on_btnExecute_clicked()
         }
 
     } else if (actionType == SearchAction::FindFiles || actionType == SearchAction::ReplaceFiles) {
+        cancelFindInFiles();
         int fileSearched = 0;
         int fileHitted = 0;
         QString keyword = ui->cbFind->currentText();
@@ -316,6 +328,7 @@ void SearchDialog::on_btnExecute_clicked()
                         mSearchOptions,
                         SearchFileScope::wholeProject
                         );
+            QStringList unopenedFiles;
             for (int i=0;i<pMainWindow->project()->units().count();i++) {
                 Editor * e = pMainWindow->project()->units()[i]->editor();
                 QString curFilename =  pMainWindow->project()->units()[i]->fileName();
@@ -332,24 +345,15 @@ void SearchDialog::on_btnExecute_clicked()
                         results->results.append(parentItem);
                     }
                 } else if (fileExists(curFilename)) {
-                    SynEdit editor;
-                    QByteArray realEncoding;
-                    editor.lines()->loadFromFile(curFilename,ENCODING_AUTO_DETECT, realEncoding);
                     fileSearched++;
-                    PSearchResultTreeItem parentItem = batchFindInEditor(
-                                &editor,
-                                curFilename,
-                                keyword);
-                    int t = parentItem->results.size();
-                    findCount+=t;
-                    if (t>0) {
-                        fileHitted++;
-                        results->results.append(parentItem);
-                    }
-
+                    unopenedFiles.append(curFilename);
                 }
             }
             pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+            // results of the other files are added to the view when they are found
+            mFindInFilesCount = findCount;
+            mFindInFilesFileHitted = fileHitted;
+            findInFilesInBackground(unopenedFiles, keyword, results);
         }
         pMainWindow->showSearchPanel(actionType == SearchAction::ReplaceFiles);
     }
@@ -419,6 +423,140 @@ std::shared_ptr<SearchResultTreeItem> SearchDialog::batchFindInEditor(SynEdit *e
     return parentItem;
 }
 
+// Only a case sensitive ascii keyword can be matched in the raw bytes of a
+// file, whatever its encoding is. Returns true if the file must be searched.
+static bool fileMayContain(const QString& filename, const QString& keyword,
+                           SynSearchOptions options)
+{
+    if (options.testFlag(ssoRegExp) || !options.testFlag(ssoMatchCase)
+            || !isTextAllAscii(keyword))
+        return true;
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly))
+        return true;
+    qint64 size = file.size();
+    uchar* mapped = file.map(0,size);
+    QByteArray content;
+    if (mapped)
+        content = QByteArray::fromRawData((const char*)mapped,size);
+    else
+        content = file.readAll();
+    bool found = QByteArrayMatcher(keyword.toLatin1()).indexIn(content) >= 0;
+    if (mapped)
+        file.unmap(mapped);
+    return found;
+}
+
+// Searches a file that's not opened in an editor. It's run in the thread pool,
+// so it uses its own search engine and doesn't touch any widget.
+struct FindInFileFunctor {
+    typedef PSearchResultTreeItem result_type;
+
+    QString keyword;
+    SynSearchOptions options;
+
+    PSearchResultTreeItem operator()(const QString& filename) const {
+        PSearchResultTreeItem parentItem = std::make_shared<SearchResultTreeItem>();
+        parentItem->filename = filename;
+        parentItem->parent = nullptr;
+        if (!fileMayContain(filename, keyword, options))
+            return parentItem;
+        SynEditStringList lines(nullptr);
+        QByteArray realEncoding;
+        try {
+            lines.loadFromFile(filename,ENCODING_AUTO_DETECT, realEncoding);
+        } catch (FileError&) {
+            return parentItem;
+        }
+        std::unique_ptr<SynSearchBase> searchEngine;
+        if (options.testFlag(ssoRegExp))
+            searchEngine = std::unique_ptr<SynSearchBase>(new SynSearchRegex());
+        else
+            searchEngine = std::unique_ptr<SynSearchBase>(new SynSearch());
+        searchEngine->setOptions(options);
+        searchEngine->setPattern(keyword);
+        for (int i=0;i<lines.count();i++) {
+            QString line = lines.getString(i);
+            int count = searchEngine->findAll(line);
+            for (int j=0;j<count;j++) {
+                PSearchResultTreeItem item = std::make_shared<SearchResultTreeItem>();
+                item->filename = filename;
+                item->line = i+1;
+                item->start = searchEngine->result(j)+1;
+                item->len = searchEngine->length(j);
+                item->parent = parentItem.get();
+                item->text = line;
+                item->text.replace('\t',' ');
+                parentItem->results.append(item);
+            }
+        }
+        return parentItem;
+    }
+};
+
+void SearchDialog::findInFilesInBackground(const QStringList &files, const QString &keyword,
+                                           PSearchResults results)
+{
+    if (files.isEmpty())
+        return;
+    mFindInFilesResults = results;
+    mFindInFilesNotifyTimer.start();
+    FindInFileFunctor functor;
+    functor.keyword = keyword;
+    functor.options = mSearchOptions;
+    mFindInFilesWatcher.setFuture(QtConcurrent::mapped(files, functor));
+}
+
+void SearchDialog::cancelFindInFiles()
+{
+    if (mFindInFilesWatcher.isRunning()) {
+        mFindInFilesWatcher.cancel();
+        mFindInFilesWatcher.waitForFinished();
+    }
+    mFindInFilesResults.reset();
+}
+
+void SearchDialog::onFindInFilesResultReady(int index)
+{
+    if (!mFindInFilesResults)
+        return;
+    PSearchResultTreeItem parentItem = mFindInFilesWatcher.resultAt(index);
+    if (parentItem->results.isEmpty())
+        return;
+    mFindInFilesResults->results.append(parentItem);
+    mFindInFilesCount += parentItem->results.count();
+    mFindInFilesFileHitted++;
+    // don't refresh the result view for every file
+    if (mFindInFilesNotifyTimer.elapsed() >= 200) {
+        pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+        mFindInFilesNotifyTimer.restart();
+    }
+}
+
+void SearchDialog::onFindInFilesFinished()
+{
+    if (!mFindInFilesResults)
+        return;
+    mFindInFilesResults.reset();
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+    pMainWindow->updateStatusbarMessage(tr("Found %1 occurrences in %2 files")
+                                        .arg(mFindInFilesCount)
+                                        .arg(mFindInFilesFileHitted));
+}
+
+void SearchDialog::onSearchResultsChanged()
+{
+    if (!mFindInFilesResults)
+        return;
+    // stop searching if its results are removed from the search panel
+    SearchResultModel* model = pMainWindow->searchResultModel();
+    for (int i=0;i<model->resultsCount();i++) {
+        if (model->results(i) == mFindInFilesResults)
+            return;
+    }
+    cancelFindInFiles();
+}
+
 QTabBar *SearchDialog::tabBar() const
 {
     return mTabBar;
@@ -2,6 +2,8 @@
 #define SEARCHDIALOG_H
 
 #include <QDialog>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include "../qsynedit/SynEdit.h"
 #include "../utils.h"
 
@@ -10,6 +12,7 @@ class SearchDialog;
 }
 
 struct SearchResultTreeItem;
+struct SearchResults;
 class QTabBar;
 class Editor;
 class SearchDialog : public QDialog
@@ -33,6 +36,7 @@ public:
     void findInFiles(const QString& keyword, SearchFileScope scope, SynSearchOptions options);
     void replace(const QString& sFind, const QString& sReplace);
     PSynSearchBase searchEngine() const;
+    void cancelFindInFiles();
 
     QTabBar *tabBar() const;
 
@@ -43,10 +47,16 @@ private slots:
    void on_btnCancel_clicked();
 
    void on_btnExecute_clicked();
+
+   void onFindInFilesResultReady(int index);
+   void onFindInFilesFinished();
+   void onSearchResultsChanged();
 private:
    int execute(SynEdit* editor, const QString& sSearch,
                const QString& sReplace, SynSearchMathedProc matchCallback = nullptr);
    std::shared_ptr<SearchResultTreeItem> batchFindInEditor(SynEdit * editor,const QString& filename, const QString& keyword);
+   void findInFilesInBackground(const QStringList& files, const QString& keyword,
+                                std::shared_ptr<SearchResults> results);
 private:
     Ui::SearchDialog *ui;
     QTabBar *mTabBar;
@@ -54,6 +64,12 @@ private:
     PSynSearchBase mSearchEngine;
     PSynSearchBase mBasicSearchEngine;
     PSynSearchBase mRegexSearchEngine;
+    // searching files that are not opened in editors
+    QFutureWatcher<std::shared_ptr<SearchResultTreeItem>> mFindInFilesWatcher;
+    std::shared_ptr<SearchResults> mFindInFilesResults;
+    QElapsedTimer mFindInFilesNotifyTimer;
+    int mFindInFilesCount; // hits of the whole search, including the opened files
+    int mFindInFilesFileHitted;
 };
 
 #endif // SEARCHDIALOG_H